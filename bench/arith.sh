@@ -0,0 +1,15 @@
+# Arithmetic expansion in a loop: counters and a mixed-precedence expression.
+# Usage: cvx bench/arith.sh [iterations]
+n=20000
+if [ -n "$1" ]; then n=$1; fi
+run() {
+    i=0
+    x=0
+    while [ $i -lt $n ]; do
+        x=$(( (x * 31 + i % 7) & 0xffff ))
+        y=$(( i > 100 ? x << 2 : x >> 1 ))
+        i=$((i+1))
+    done
+    echo $x $y
+}
+run
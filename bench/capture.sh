@@ -0,0 +1,14 @@
+# Command substitution of a large external command's output.
+# Usage: cvx bench/capture.sh [iterations]
+n=20
+if [ -n "$1" ]; then n=$1; fi
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        x=$(seq 1 500000)
+        for w in $(seq 1 100000); do :; done
+        i=$((i+1))
+    done
+    echo "$x" | tail -n 1
+}
+run
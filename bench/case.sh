@@ -0,0 +1,23 @@
+# A dispatcher: one case with 2000 literal arms, run 20000 times. The
+# arms are hashed when the script is parsed, so each dispatch is one
+# lookup instead of a walk over every pattern.
+# Usage: cvx bench/case.sh [arms] [iterations]; $CVX picks the shell
+# that runs the generated script (./cvx by default).
+arms=2000
+iters=20000
+if [ -n "$1" ]; then arms=$1; fi
+if [ -n "$2" ]; then iters=$2; fi
+f=/tmp/cvx-case-bench.sh
+echo 'hits=0' > $f
+echo 'for ((i = 0; i < '$iters'; i++)); do' >> $f
+echo '    k=cmd$((i % '$arms'))' >> $f
+echo '    case $k in' >> $f
+for ((a = 0; a < arms; a++)); do
+    echo "        cmd$a) hits=\$((hits + 1));;" >> $f
+done
+echo '        *.bak|*~) ;;' >> $f
+echo '        *) echo "unknown $k";;' >> $f
+echo '    esac' >> $f
+echo 'done' >> $f
+echo 'echo $hits' >> $f
+${CVX:-./cvx} $f
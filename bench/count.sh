@@ -0,0 +1,21 @@
+# Counting loop written with [ ] and $(( )) versus for (( )) and (( )).
+# Usage: cvx bench/count.sh [iterations] [while]
+n=100000
+if [ -n "$1" ]; then n=$1; fi
+classic() {
+    i=0
+    sum=0
+    while [ $i -lt $n ]; do
+        sum=$((sum + i))
+        i=$((i+1))
+    done
+    echo $sum
+}
+native() {
+    sum=0
+    for ((i = 0; i < n; i++)); do
+        ((sum += i))
+    done
+    echo $sum
+}
+if [ "$2" = "while" ]; then classic; else native; fi
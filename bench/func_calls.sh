@@ -0,0 +1,20 @@
+# Function call overhead: a tight loop calling a small helper function.
+# Usage: cvx bench/func_calls.sh [calls]
+n=100000
+if [ -n "$1" ]; then n=$1; fi
+helper() {
+    if [ "$1" = "skip" ]; then
+        return_code=1
+    elif [ "$1" = "count" ]; then
+        c=$((c+1))
+    else
+        :
+    fi
+}
+c=0
+i=0
+while [ $i -lt $n ]; do
+    helper count
+    i=$((i+1))
+done
+echo $c
@@ -0,0 +1,24 @@
+# Pathname expansion over a tree of 200000 files in 1000 directories.
+# The two patterns of each command share one read of every directory;
+# the ** walk spreads over CVX_GLOB_THREADS threads once the tree is deep.
+# Usage: cvx bench/glob.sh [dir]
+dir=/tmp/cvx-glob-bench
+if [ -n "$1" ]; then dir=$1; fi
+if [ ! -d $dir ]; then
+    mkdir -p $dir
+    for a in {0..19}; do
+        for b in {0..49}; do
+            mkdir -p $dir/d$a/e$b
+            (cd $dir/d$a/e$b && touch f{0..99}.c f{0..99}.txt)
+        done
+    done
+fi
+cd $dir
+i=0
+while [ $i -lt 10 ]; do
+    : */*/*.c */*/*.txt
+    i=$((i+1))
+done
+shopt -s globstar
+set -- **/*.c
+echo $#
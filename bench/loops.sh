@@ -0,0 +1,19 @@
+# Loop dispatch: nested while/for/case with cheap builtin bodies.
+# Usage: cvx bench/loops.sh [iterations] [tree]
+# Passing "tree" as the second argument runs the body on the AST walker
+# instead of the bytecode VM so the two can be compared.
+n=20000
+if [ -n "$1" ]; then n=$1; fi
+if [ "$2" = "tree" ]; then shopt -s treewalk; fi
+body() {
+    i=0
+    hits=0
+    while [ $i -lt $n ]; do
+        for k in a b c; do
+            case $k in a) : ;; b) hits=$((hits+1)) ;; *) : ;; esac
+        done
+        i=$((i+1))
+    done
+    echo $hits
+}
+body
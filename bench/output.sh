@@ -0,0 +1,17 @@
+# Builtin output: echo and printf in a loop, written to a file.
+# Usage: cvx bench/output.sh [iterations] [file]
+# For syscall counts run it under strace -c -e trace=write.
+n=20000
+out=/dev/null
+if [ -n "$1" ]; then n=$1; fi
+if [ -n "$2" ]; then out=$2; fi
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        echo "line $i of the echo loop"
+        printf '%s %d %s\n' line $i "of the printf loop"
+        i=$((i+1))
+    done
+}
+run > $out
+echo $n
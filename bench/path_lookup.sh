@@ -0,0 +1,15 @@
+# External command lookup: a long PATH with the command in the last
+# directory, run in a loop.
+# Usage: cvx bench/path_lookup.sh [iterations]
+n=2000
+if [ -n "$1" ]; then n=$1; fi
+PATH=/nonexistent/a:/nonexistent/b:/nonexistent/c:/nonexistent/d:/nonexistent/e:/nonexistent/f:/nonexistent/g:/nonexistent/h:/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        true
+        i=$((i+1))
+    done
+    echo $i
+}
+run
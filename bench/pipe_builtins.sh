@@ -0,0 +1,19 @@
+# Pipelines whose producer is a builtin or a shell function.
+# Usage: cvx bench/pipe_builtins.sh [iterations]
+n=1000
+if [ -n "$1" ]; then n=$1; fi
+payload="the quick brown fox jumps over the lazy dog"
+emit() {
+    echo "$payload"
+    echo "$payload"
+}
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        echo "$payload" | /bin/cat > /dev/null
+        emit | /bin/cat > /dev/null
+        i=$((i+1))
+    done
+    echo $i
+}
+run
@@ -0,0 +1,24 @@
+# pmap against xargs -P on the same input: one process per record, then
+# batches of 100 records. pmap spawns from the shell itself and keeps
+# each run's output whole and in input order; xargs does neither.
+# Usage: cvx bench/pmap.sh [records] [jobs]
+n=5000
+j=8
+if [ -n "$1" ]; then n=$1; fi
+if [ -n "$2" ]; then j=$2; fi
+f=/tmp/cvx-pmap-bench
+seq 1 $n > $f
+
+t0=$(date +%s%N)
+pmap -j $j true < $f
+t1=$(date +%s%N)
+xargs -P $j -n 1 true < $f
+t2=$(date +%s%N)
+echo "1 per run:   pmap $(( (t1 - t0) / 1000000 )) ms, xargs -P $(( (t2 - t1) / 1000000 )) ms"
+
+t0=$(date +%s%N)
+pmap -j $j -n 100 echo < $f > $f.pmap
+t1=$(date +%s%N)
+xargs -P $j -n 100 echo < $f > $f.xargs
+t2=$(date +%s%N)
+echo "100 per run: pmap $(( (t1 - t0) / 1000000 )) ms, xargs -P $(( (t2 - t1) / 1000000 )) ms"
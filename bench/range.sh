@@ -0,0 +1,10 @@
+# A million-iteration for loop over a brace range. The range is counted
+# as the loop runs, so it neither forks nor holds the list in memory.
+# Usage: cvx bench/range.sh
+count() {
+    for i in {1..1000000}; do
+        :
+    done
+    echo $i
+}
+count
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Runs one benchmark script under the given shells and reports wall time.
+# Usage: bench/run.sh <script> [args...]
+# Set CVX to a space separated list of binaries to compare, e.g.
+#   CVX="/tmp/cvx-old ./cvx" bench/run.sh bench/func_calls.sh 100000
+
+script=$1
+shift
+for bin in ${CVX:-./cvx}; do
+    start=$(date +%s%N)
+    out=$("$bin" "$script" "$@" 2>&1 | tail -n 1)
+    end=$(date +%s%N)
+    ms=$(( (end - start) / 1000000 ))
+    printf '%-24s %-28s %8d ms  (%s)\n' "$bin" "$(basename "$script") $*" "$ms" "$out"
+done
@@ -0,0 +1,21 @@
+# External command launch cost with the shell holding extra memory.
+# Usage: cvx bench/spawn.sh [iterations] [ballast MB] [spawn|fork]
+# Compare sizes with e.g. for mb in 0 64 256; do ... done; the fork mode
+# sets shopt forkexec to take the old fork+exec path.
+n=2000
+mb=0
+if [ -n "$1" ]; then n=$1; fi
+if [ -n "$2" ]; then mb=$2; fi
+if [ "$3" = fork ]; then shopt -s forkexec; fi
+if [ $mb -gt 0 ]; then
+    ballast=$(head -c $((mb * 1048576)) /dev/zero | tr '\0' x)
+fi
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        /bin/true
+        i=$((i+1))
+    done
+    echo $i
+}
+run
@@ -0,0 +1,18 @@
+# A for loop over a directory of 300000 files. With nosortglob the list
+# is read from the directory as the loop runs: the body starts at once
+# and memory stays flat. Without it the list is built and sorted first.
+# Usage: cvx bench/spool.sh [dir] [sort]
+dir=/tmp/cvx-spool-bench
+if [ -n "$1" ]; then dir=$1; fi
+if [ ! -d $dir ]; then
+    mkdir -p $dir
+    for a in {0..299}; do
+        (cd $dir && touch m$a-{0..999}.eml)
+    done
+fi
+if [ -z "$2" ]; then shopt -s nosortglob; fi
+n=0
+for f in $dir/*.eml; do
+    n=$((n+1))
+done
+echo $n
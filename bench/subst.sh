@@ -0,0 +1,21 @@
+# Command substitution of builtins and shell functions in a loop.
+# Usage: cvx bench/subst.sh [iterations]
+n=2000
+if [ -n "$1" ]; then n=$1; fi
+upper() {
+    if [ "$1" = abc ]; then
+        echo ABC
+    else
+        echo "$1"
+    fi
+}
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        x=$(upper abc)
+        y=$(echo "$x $i")
+        i=$((i+1))
+    done
+    echo "$y"
+}
+run
@@ -0,0 +1,16 @@
+# Variable assignment and lookup in a loop. The loop variable is
+# reassigned on every iteration, so memory use should stay flat.
+# Usage: cvx bench/vars.sh [iterations]
+n=200000
+if [ -n "$1" ]; then n=$1; fi
+run() {
+    i=0
+    v=start
+    while [ $i -lt $n ]; do
+        v=value$i
+        w=$v
+        i=$((i+1))
+    done
+    echo $w
+}
+run
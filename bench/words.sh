@@ -0,0 +1,16 @@
+# Word expansion: commands made of literal words versus words that
+# need parameter expansion, run inside a tight loop.
+# Usage: cvx bench/words.sh [iterations]
+n=20000
+if [ -n "$1" ]; then n=$1; fi
+run() {
+    i=0
+    while [ $i -lt $n ]; do
+        : alpha beta gamma delta epsilon zeta eta theta
+        : "quoted words" 'single quoted' plain/path/name.txt
+        : $i $n "$i"
+        i=$((i+1))
+    done
+    echo $i
+}
+run
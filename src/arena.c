@@ -0,0 +1,79 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN sizeof(void *)
+#define ARENA_SPARE_MAX 4
+
+// Most arenas (one per command line) never outgrow their first block, so
+// released first-size blocks are kept for the next arena instead of
+// going back through malloc.
+static ArenaBlock *spare_blocks[ARENA_SPARE_MAX];
+static int spare_count = 0;
+
+void arena_init(Arena *arena) {
+    arena->head = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *b = arena->head;
+    if (!b || b->used + size > b->size) {
+        size_t block_size = ARENA_BLOCK_SIZE;
+        // Grow blocks with the arena so large scripts need few of them.
+        if (b && b->size * 2 <= 1024 * 1024) block_size = b->size * 2;
+        if (size > block_size) block_size = size;
+        ArenaBlock *nb;
+        if (block_size == ARENA_BLOCK_SIZE && spare_count > 0) {
+            nb = spare_blocks[--spare_count];
+        } else {
+            nb = malloc(sizeof(ArenaBlock) + block_size);
+            if (!nb) return NULL;
+        }
+        nb->used = 0;
+        nb->size = block_size;
+        nb->next = b;
+        arena->head = nb;
+        b = nb;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+void *arena_calloc(Arena *arena, size_t size) {
+    void *p = arena_alloc(arena, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t len) {
+    char *p = arena_alloc(arena, len + 1);
+    if (!p) return NULL;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_release(Arena *arena) {
+    ArenaBlock *b = arena->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        if (b->size == ARENA_BLOCK_SIZE && spare_count < ARENA_SPARE_MAX)
+            spare_blocks[spare_count++] = b;
+        else
+            free(b);
+        b = next;
+    }
+    arena->head = NULL;
+}
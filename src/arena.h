@@ -0,0 +1,31 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator. Everything allocated from an arena is released at once
+// by arena_release(); there is no per-object free.
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+} Arena;
+
+void arena_init(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_calloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+char *arena_strdup(Arena *arena, const char *s);
+void arena_release(Arena *arena);
+
+#endif
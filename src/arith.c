@@ -0,0 +1,607 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "arith.h"
+#include "vars.h"
+
+#define ARITH_BUCKETS 64
+#define ARITH_MAX_CACHED 256
+#define ARITH_MAX_NEST 256
+// A variable whose value is not a number is evaluated as an expression
+// itself, up to this many levels deep.
+#define ARITH_MAX_DEPTH 16
+
+enum {
+    A_NUM, A_LOAD, A_STORE, A_PREINC, A_PREDEC, A_POSTINC, A_POSTDEC,
+    A_NEG, A_NOT, A_BNOT,
+    A_POW, A_MUL, A_DIV, A_MOD, A_ADD, A_SUB, A_SHL, A_SHR,
+    A_LT, A_LE, A_GT, A_GE, A_EQ, A_NE, A_BAND, A_BXOR, A_BOR,
+    A_AND, A_OR, A_BOOL, A_JZ, A_JMP, A_POP
+};
+
+// arg is the constant for A_NUM, the offset of the name in the program's
+// name pool for variable ops, and the target for jumps.
+typedef struct {
+    unsigned char op;
+    long arg;
+} Insn;
+
+typedef struct ArithProg {
+    char *src;
+    unsigned hash;
+    Insn *code;
+    int ncode;
+    char *names;
+    struct ArithProg *next;
+} ArithProg;
+
+enum {
+    T_END, T_NUM, T_NAME, T_OP, T_ASSIGN, T_INC, T_DEC,
+    T_LPAREN, T_RPAREN, T_QUEST, T_COLON, T_COMMA
+};
+
+// op is the A_ operator of T_OP, and of T_ASSIGN's compound form (-1 for
+// plain =).
+typedef struct {
+    int type;
+    int op;
+    long val;
+    int start, len;
+} Token;
+
+typedef struct {
+    const char *src;
+    Token *toks;
+    int ntoks;
+    int pos;
+    Insn *code;
+    int ncode, code_cap;
+    char *names;
+    size_t names_len, names_cap;
+    int nest;
+    bool error;
+} Compiler;
+
+static ArithProg *buckets[ARITH_BUCKETS];
+static int ncached = 0;
+static int running = 0;
+
+static const struct { const char *text; int type; int op; } operators[] = {
+    { "<<=", T_ASSIGN, A_SHL }, { ">>=", T_ASSIGN, A_SHR },
+    { "**", T_OP, A_POW },
+    { "<<", T_OP, A_SHL }, { ">>", T_OP, A_SHR },
+    { "<=", T_OP, A_LE }, { ">=", T_OP, A_GE },
+    { "==", T_OP, A_EQ }, { "!=", T_OP, A_NE },
+    { "&&", T_OP, A_AND }, { "||", T_OP, A_OR },
+    { "++", T_INC, 0 }, { "--", T_DEC, 0 },
+    { "*=", T_ASSIGN, A_MUL }, { "/=", T_ASSIGN, A_DIV }, { "%=", T_ASSIGN, A_MOD },
+    { "+=", T_ASSIGN, A_ADD }, { "-=", T_ASSIGN, A_SUB },
+    { "&=", T_ASSIGN, A_BAND }, { "^=", T_ASSIGN, A_BXOR }, { "|=", T_ASSIGN, A_BOR },
+    { "+", T_OP, A_ADD }, { "-", T_OP, A_SUB }, { "*", T_OP, A_MUL },
+    { "/", T_OP, A_DIV }, { "%", T_OP, A_MOD },
+    { "<", T_OP, A_LT }, { ">", T_OP, A_GT },
+    { "&", T_OP, A_BAND }, { "^", T_OP, A_BXOR }, { "|", T_OP, A_BOR },
+    { "!", T_OP, A_NOT }, { "~", T_OP, A_BNOT },
+    { "=", T_ASSIGN, -1 },
+    { "(", T_LPAREN, 0 }, { ")", T_RPAREN, 0 },
+    { "?", T_QUEST, 0 }, { ":", T_COLON, 0 }, { ",", T_COMMA, 0 },
+};
+
+static unsigned hash_text(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Glob and quote markers left in the text by word expansion read as the
+// characters they stand for, or as blanks.
+static int source_char(char c) {
+    if (c == '\x01') return '*';
+    if (c == '\x02') return '?';
+    if ((c >= '\x03' && c <= '\x07') || c == '\x10' || c == '\x11') return ' ';
+    return (unsigned char)c;
+}
+
+static bool is_name_start(int c) {
+    return isalpha(c) || c == '_';
+}
+
+static bool is_name_char(int c) {
+    return isalnum(c) || c == '_';
+}
+
+static void syntax_error(const char *src, const char *what) {
+    fprintf(stderr, "cvx: arithmetic: %s: %s\n", what, src);
+}
+
+// Splits src into tokens. ++ and -- only stay increments next to a name,
+// so 1--1 reads as 1 - -1.
+static Token *tokenize(const char *src, int *count) {
+    size_t len = strlen(src);
+    Token *toks = malloc((len + 1) * sizeof(Token));
+    if (!toks) return NULL;
+    int n = 0;
+    size_t i = 0;
+    while (i < len) {
+        int c = source_char(src[i]);
+        if (isspace(c)) {
+            i++;
+            continue;
+        }
+        Token *t = &toks[n];
+        t->start = i;
+        t->op = 0;
+        t->val = 0;
+        if (isdigit(c)) {
+            char *end;
+            t->type = T_NUM;
+            t->val = (long)strtoul(src + i, &end, 0);
+            i = end - src;
+            if (i < len && is_name_char(source_char(src[i]))) {
+                syntax_error(src, "invalid number");
+                free(toks);
+                return NULL;
+            }
+        } else if (is_name_start(c)) {
+            t->type = T_NAME;
+            while (i < len && is_name_char(source_char(src[i]))) i++;
+        } else {
+            size_t k, nops = sizeof(operators) / sizeof(operators[0]);
+            for (k = 0; k < nops; k++) {
+                size_t ol = strlen(operators[k].text), m;
+                for (m = 0; m < ol && i + m < len; m++)
+                    if (source_char(src[i + m]) != operators[k].text[m]) break;
+                if (m == ol) break;
+            }
+            if (k == nops) {
+                syntax_error(src, "syntax error");
+                free(toks);
+                return NULL;
+            }
+            t->type = operators[k].type;
+            t->op = operators[k].op;
+            i += strlen(operators[k].text);
+            if (t->type == T_INC || t->type == T_DEC) {
+                size_t j = i;
+                while (j < len && isspace(source_char(src[j]))) j++;
+                bool after_name = n > 0 && toks[n - 1].type == T_NAME;
+                bool before_name = j < len && is_name_start(source_char(src[j]));
+                if (!after_name && !before_name) {
+                    int op = t->type == T_INC ? A_ADD : A_SUB;
+                    for (int k2 = 0; k2 < 2; k2++) {
+                        toks[n].type = T_OP;
+                        toks[n].op = op;
+                        toks[n].val = 0;
+                        toks[n].start = i - 2 + k2;
+                        toks[n].len = 1;
+                        n++;
+                    }
+                    continue;
+                }
+            }
+        }
+        t->len = i - t->start;
+        n++;
+    }
+    toks[n].type = T_END;
+    toks[n].start = len;
+    toks[n].len = 0;
+    *count = n;
+    return toks;
+}
+
+static int emit(Compiler *c, int op, long arg) {
+    if (c->ncode == c->code_cap) {
+        int cap = c->code_cap ? c->code_cap * 2 : 16;
+        Insn *code = realloc(c->code, cap * sizeof(Insn));
+        if (!code) {
+            c->error = true;
+            return c->ncode - 1;
+        }
+        c->code = code;
+        c->code_cap = cap;
+    }
+    c->code[c->ncode].op = op;
+    c->code[c->ncode].arg = arg;
+    return c->ncode++;
+}
+
+static void patch(Compiler *c, int at) {
+    if (at >= 0 && at < c->ncode) c->code[at].arg = c->ncode;
+}
+
+static long add_name(Compiler *c, const Token *t) {
+    if (c->names_len + t->len + 1 > c->names_cap) {
+        size_t cap = c->names_cap ? c->names_cap * 2 : 64;
+        while (cap < c->names_len + t->len + 1) cap *= 2;
+        char *names = realloc(c->names, cap);
+        if (!names) {
+            c->error = true;
+            return 0;
+        }
+        c->names = names;
+        c->names_cap = cap;
+    }
+    long off = c->names_len;
+    memcpy(c->names + off, c->src + t->start, t->len);
+    c->names[off + t->len] = '\0';
+    c->names_len += t->len + 1;
+    return off;
+}
+
+static Token *peek(Compiler *c) {
+    return &c->toks[c->pos];
+}
+
+static void fail(Compiler *c) {
+    if (!c->error) syntax_error(c->src, "syntax error");
+    c->error = true;
+}
+
+static void expr_comma(Compiler *c);
+static void expr_assign(Compiler *c);
+
+static int precedence(int op) {
+    switch (op) {
+    case A_OR: return 1;
+    case A_AND: return 2;
+    case A_BOR: return 3;
+    case A_BXOR: return 4;
+    case A_BAND: return 5;
+    case A_EQ: case A_NE: return 6;
+    case A_LT: case A_LE: case A_GT: case A_GE: return 7;
+    case A_SHL: case A_SHR: return 8;
+    case A_ADD: case A_SUB: return 9;
+    case A_MUL: case A_DIV: case A_MOD: return 10;
+    case A_POW: return 11;
+    default: return 0;
+    }
+}
+
+static void expr_unary(Compiler *c) {
+    if (c->error) return;
+    if (++c->nest > ARITH_MAX_NEST) {
+        fail(c);
+        return;
+    }
+    Token *t = peek(c);
+    if (t->type == T_OP && (t->op == A_ADD || t->op == A_SUB || t->op == A_NOT || t->op == A_BNOT)) {
+        int op = t->op;
+        c->pos++;
+        expr_unary(c);
+        if (op == A_SUB) emit(c, A_NEG, 0);
+        else if (op != A_ADD) emit(c, op, 0);
+    } else if (t->type == T_INC || t->type == T_DEC) {
+        c->pos++;
+        Token *name = peek(c);
+        if (name->type != T_NAME) {
+            fail(c);
+        } else {
+            c->pos++;
+            emit(c, t->type == T_INC ? A_PREINC : A_PREDEC, add_name(c, name));
+        }
+    } else if (t->type == T_NUM) {
+        c->pos++;
+        emit(c, A_NUM, t->val);
+    } else if (t->type == T_NAME) {
+        c->pos++;
+        Token *next = peek(c);
+        if (next->type == T_INC || next->type == T_DEC) {
+            c->pos++;
+            emit(c, next->type == T_INC ? A_POSTINC : A_POSTDEC, add_name(c, t));
+        } else {
+            emit(c, A_LOAD, add_name(c, t));
+        }
+    } else if (t->type == T_LPAREN) {
+        c->pos++;
+        expr_comma(c);
+        if (peek(c)->type != T_RPAREN) fail(c);
+        else c->pos++;
+    } else {
+        fail(c);
+    }
+    c->nest--;
+}
+
+// Precedence climbing over the binary operators. && and || jump over
+// their right operand when the left one decides the result.
+static void expr_binary(Compiler *c, int min_prec) {
+    expr_unary(c);
+    while (!c->error) {
+        Token *t = peek(c);
+        int prec = t->type == T_OP ? precedence(t->op) : 0;
+        if (prec == 0 || prec < min_prec) break;
+        int op = t->op;
+        c->pos++;
+        if (op == A_AND || op == A_OR) {
+            int jump = emit(c, op, 0);
+            expr_binary(c, prec + 1);
+            emit(c, A_BOOL, 0);
+            patch(c, jump);
+            continue;
+        }
+        expr_binary(c, op == A_POW ? prec : prec + 1);
+        emit(c, op, 0);
+    }
+}
+
+static void expr_ternary(Compiler *c) {
+    expr_binary(c, 1);
+    if (c->error || peek(c)->type != T_QUEST) return;
+    c->pos++;
+    int to_else = emit(c, A_JZ, 0);
+    expr_comma(c);
+    if (peek(c)->type != T_COLON) {
+        fail(c);
+        return;
+    }
+    c->pos++;
+    int to_end = emit(c, A_JMP, 0);
+    patch(c, to_else);
+    expr_assign(c);
+    patch(c, to_end);
+}
+
+static void expr_assign(Compiler *c) {
+    if (c->error) return;
+    Token *t = peek(c);
+    if (t->type == T_NAME && c->toks[c->pos + 1].type == T_ASSIGN) {
+        int op = c->toks[c->pos + 1].op;
+        long name = add_name(c, t);
+        c->pos += 2;
+        if (op >= 0) emit(c, A_LOAD, name);
+        expr_assign(c);
+        if (op >= 0) emit(c, op, 0);
+        emit(c, A_STORE, name);
+        return;
+    }
+    expr_ternary(c);
+}
+
+static void expr_comma(Compiler *c) {
+    expr_assign(c);
+    while (!c->error && peek(c)->type == T_COMMA) {
+        c->pos++;
+        emit(c, A_POP, 0);
+        expr_assign(c);
+    }
+}
+
+static void free_prog(ArithProg *p) {
+    if (!p) return;
+    free(p->src);
+    free(p->code);
+    free(p->names);
+    free(p);
+}
+
+static ArithProg *compile(const char *src) {
+    Compiler c = { 0 };
+    c.src = src;
+    c.toks = tokenize(src, &c.ntoks);
+    if (!c.toks) return NULL;
+    if (c.ntoks == 0) {
+        emit(&c, A_NUM, 0);
+    } else {
+        expr_comma(&c);
+        if (!c.error && peek(&c)->type != T_END) fail(&c);
+    }
+    free(c.toks);
+
+    ArithProg *p = calloc(1, sizeof(ArithProg));
+    if (c.error || !p) {
+        free(c.code);
+        free(c.names);
+        free(p);
+        return NULL;
+    }
+    p->src = strdup(src);
+    p->code = c.code;
+    p->ncode = c.ncode;
+    p->names = c.names;
+    return p;
+}
+
+static void clear_cache(void) {
+    for (int i = 0; i < ARITH_BUCKETS; i++) {
+        while (buckets[i]) {
+            ArithProg *p = buckets[i];
+            buckets[i] = p->next;
+            free_prog(p);
+        }
+    }
+    ncached = 0;
+}
+
+// Returns the compiled program for src. *owned is set when the program
+// could not be cached and must be freed by the caller: the cache is only
+// emptied when no program is running.
+static ArithProg *get_prog(const char *src, bool *owned) {
+    unsigned h = hash_text(src);
+    *owned = false;
+    for (ArithProg *p = buckets[h & (ARITH_BUCKETS - 1)]; p; p = p->next)
+        if (p->hash == h && strcmp(p->src, src) == 0) return p;
+
+    ArithProg *p = compile(src);
+    if (!p) return NULL;
+    p->hash = h;
+    if (ncached >= ARITH_MAX_CACHED) {
+        if (running > 0) {
+            *owned = true;
+            return p;
+        }
+        clear_cache();
+    }
+    p->next = buckets[h & (ARITH_BUCKETS - 1)];
+    buckets[h & (ARITH_BUCKETS - 1)] = p;
+    ncached++;
+    return p;
+}
+
+static bool eval_text(const char *src, long *result, int depth);
+
+// Unset and empty variables are 0; anything that is not a plain number is
+// evaluated as an expression.
+static bool load_var(const char *name, long *v, int depth) {
+    const char *s = vars_get(name);
+    while (s && isspace((unsigned char)*s)) s++;
+    if (!s || !*s) {
+        *v = 0;
+        return true;
+    }
+    char *end;
+    const char *digits = (*s == '-' || *s == '+') ? s + 1 : s;
+    if (isdigit((unsigned char)*digits)) {
+        unsigned long u = strtoul(digits, &end, 0);
+        while (isspace((unsigned char)*end)) end++;
+        if (!*end) {
+            *v = *s == '-' ? (long)(0UL - u) : (long)u;
+            return true;
+        }
+    }
+    if (depth >= ARITH_MAX_DEPTH) {
+        fprintf(stderr, "cvx: arithmetic: %s: expression recursion level exceeded\n", name);
+        return false;
+    }
+    return eval_text(s, v, depth + 1);
+}
+
+static void store_var(const char *name, long v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%ld", v);
+    vars_set(name, buf);
+}
+
+static bool binary(int op, long a, long b, long *r, const char *src) {
+    unsigned long ua = a, ub = b;
+    switch (op) {
+    case A_ADD: *r = (long)(ua + ub); break;
+    case A_SUB: *r = (long)(ua - ub); break;
+    case A_MUL: *r = (long)(ua * ub); break;
+    case A_DIV:
+    case A_MOD:
+        if (b == 0) {
+            fprintf(stderr, "cvx: arithmetic: division by zero: %s\n", src);
+            return false;
+        }
+        if (a == LONG_MIN && b == -1) *r = op == A_DIV ? LONG_MIN : 0;
+        else *r = op == A_DIV ? a / b : a % b;
+        break;
+    case A_POW:
+        if (b < 0) {
+            fprintf(stderr, "cvx: arithmetic: exponent less than 0: %s\n", src);
+            return false;
+        }
+        *r = 1;
+        for (unsigned long base = ua; b > 0; b >>= 1) {
+            if (b & 1) *r = (long)((unsigned long)*r * base);
+            base *= base;
+        }
+        break;
+    case A_SHL: *r = (long)(ua << (ub & 63)); break;
+    case A_SHR: *r = a >> (ub & 63); break;
+    case A_LT: *r = a < b; break;
+    case A_LE: *r = a <= b; break;
+    case A_GT: *r = a > b; break;
+    case A_GE: *r = a >= b; break;
+    case A_EQ: *r = a == b; break;
+    case A_NE: *r = a != b; break;
+    case A_BAND: *r = a & b; break;
+    case A_BXOR: *r = a ^ b; break;
+    case A_BOR: *r = a | b; break;
+    default: *r = 0; break;
+    }
+    return true;
+}
+
+static bool run(const ArithProg *p, long *stack, long *result, int depth) {
+    int sp = 0;
+    for (int pc = 0; pc < p->ncode; pc++) {
+        const Insn *in = &p->code[pc];
+        switch (in->op) {
+        case A_NUM:
+            stack[sp++] = in->arg;
+            break;
+        case A_LOAD:
+            if (!load_var(p->names + in->arg, &stack[sp++], depth)) return false;
+            break;
+        case A_STORE:
+            store_var(p->names + in->arg, stack[sp - 1]);
+            break;
+        case A_PREINC:
+        case A_PREDEC:
+        case A_POSTINC:
+        case A_POSTDEC: {
+            long old;
+            if (!load_var(p->names + in->arg, &old, depth)) return false;
+            bool inc = in->op == A_PREINC || in->op == A_POSTINC;
+            long now = (long)((unsigned long)old + (inc ? 1UL : -1UL));
+            store_var(p->names + in->arg, now);
+            stack[sp++] = (in->op == A_PREINC || in->op == A_PREDEC) ? now : old;
+            break;
+        }
+        case A_NEG: stack[sp - 1] = (long)(0UL - (unsigned long)stack[sp - 1]); break;
+        case A_NOT: stack[sp - 1] = !stack[sp - 1]; break;
+        case A_BNOT: stack[sp - 1] = ~stack[sp - 1]; break;
+        case A_BOOL: stack[sp - 1] = stack[sp - 1] != 0; break;
+        case A_AND:
+        case A_OR:
+            if ((stack[sp - 1] != 0) == (in->op == A_OR)) {
+                stack[sp - 1] = in->op == A_OR;
+                pc = in->arg - 1;
+            } else {
+                sp--;
+            }
+            break;
+        case A_JZ:
+            if (stack[--sp] == 0) pc = in->arg - 1;
+            break;
+        case A_JMP:
+            pc = in->arg - 1;
+            break;
+        case A_POP:
+            sp--;
+            break;
+        default:
+            sp--;
+            if (!binary(in->op, stack[sp - 1], stack[sp], &stack[sp - 1], p->src)) return false;
+            break;
+        }
+    }
+    *result = sp > 0 ? stack[sp - 1] : 0;
+    return true;
+}
+
+static bool eval_text(const char *src, long *result, int depth) {
+    bool owned;
+    ArithProg *p = get_prog(src, &owned);
+    if (!p) return false;
+
+    // Every instruction pushes at most one value.
+    long small[64];
+    long *stack = p->ncode < 64 ? small : malloc(p->ncode * sizeof(long));
+    bool ok = false;
+    if (stack) {
+        running++;
+        ok = run(p, stack, result, depth);
+        running--;
+    }
+    if (stack != small) free(stack);
+    if (owned) free_prog(p);
+    return ok;
+}
+
+bool arith_eval(const char *expr, long *result) {
+    *result = 0;
+    return eval_text(expr ? expr : "", result, 0);
+}
@@ -0,0 +1,18 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <stdbool.h>
+
+// Evaluates a shell arithmetic expression with C precedence, assignment
+// operators, ++/--, ?: and the comma operator. Each expression is compiled
+// once into a postfix program that is cached by its text; variables are
+// read from the variable store as the program runs. Returns false, after
+// printing a message, on a syntax error or division by zero.
+bool arith_eval(const char *expr, long *result);
+
+#endif
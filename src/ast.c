@@ -11,126 +11,367 @@
 #include "ast.h"
 #include "exec.h"
 #include "functions.h"
+#include "jobs.h"
 #include "utils.h"
+#include "vars.h"
+#include "out.h"
 #include <unistd.h>
 #include <sys/wait.h>
 
 extern int last_exit_status;
 
-void free_ast(ASTNode *node) {
+static void get_pipeline_cmds(ASTNode *node, ASTNode ***cmds, int *n, int *cap) {
     if (!node) return;
-    free_ast(node->left);
-    free_ast(node->right);
-    free_ast(node->cond);
-    free(node->cmd);
-    free(node->name);
-    free(node);
+    if (node->type == AST_PIPELINE) {
+        get_pipeline_cmds(node->binary.left, cmds, n, cap);
+        node = node->binary.right;
+        if (!node || node->type != AST_COMMAND) return;
+    }
+    if (node->type != AST_COMMAND) return;
+    if (*n == *cap) {
+        int grown = *cap ? *cap * 2 : 8;
+        ASTNode **v = realloc(*cmds, grown * sizeof(ASTNode *));
+        if (!v) return;
+        *cmds = v;
+        *cap = grown;
+    }
+    (*cmds)[(*n)++] = node;
 }
 
-static int get_pipeline_cmds(ASTNode *node, char *cmds[], int max_cmds) {
-    if (!node) return 0;
-    if (node->type == AST_COMMAND) {
-        cmds[0] = node->cmd;
-        return 1;
+int execute_pipeline_node(ASTNode *node, bool background) {
+    ASTNode **cmds = NULL;
+    int n = 0, cap = 0;
+    get_pipeline_cmds(node, &cmds, &n, &cap);
+    int status = execute_pipeline(cmds, n, background);
+    free(cmds);
+    return status;
+}
+
+// One alternative of a pattern list that is not a plain word: a glob,
+// or text with a $ or ` in it that is expanded every time it is tried.
+typedef struct {
+    GlobPat *pat;
+    char *text;
+    int arm;
+} CaseAlt;
+
+struct CaseTable {
+    CaseAlt *alts;
+    int nalts;
+    const char **keys;
+    int *arms;
+    unsigned mask;
+};
+
+static unsigned case_hash(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
     }
-    if (node->type == AST_PIPELINE) {
-        int n = get_pipeline_cmds(node->left, cmds, max_cmds);
-        if (n < max_cmds && node->right && node->right->type == AST_COMMAND) {
-            cmds[n++] = node->right->cmd;
+    return h;
+}
+
+static bool case_dynamic(const char *s) {
+    bool in_sq = false;
+    for (; *s; s++) {
+        if (*s == '\x04') in_sq = true;
+        else if (*s == '\x05') in_sq = false;
+        else if (*s == '\x10' && s[1]) s++;
+        else if (!in_sq && (*s == '$' || *s == '`')) return true;
+    }
+    return false;
+}
+
+// Splits every pattern list into its alternatives. Plain words go into
+// an open-addressed hash that keeps the first arm for each word; the rest
+// are kept in arm order.
+void case_compile(Arena *arena, ASTNode *node) {
+    int narms = node->case_stmt.narms, nalts = 0, nkeys = 0, cap = 0;
+    ArgVec *lists = calloc(narms ? narms : 1, sizeof(ArgVec));
+    if (!lists) return;
+    for (int i = 0; i < narms; i++) {
+        argv_init(&lists[i]);
+        split_args(node->case_stmt.arms[i].pattern, &lists[i]);
+        cap += lists[i].n;
+    }
+    CaseTable *t = arena_calloc(arena, sizeof(CaseTable));
+    CaseAlt *alts = arena_alloc(arena, (cap ? cap : 1) * sizeof(CaseAlt));
+    const char **lits = malloc((cap ? cap : 1) * sizeof(char *));
+    int *lit_arms = malloc((cap ? cap : 1) * sizeof(int));
+    if (!t || !alts || !lits || !lit_arms) goto done;
+
+    for (int i = 0; i < narms; i++) {
+        for (int k = 0; k < lists[i].n; k++) {
+            const char *word = lists[i].v[k];
+            if (strcmp(word, "|") == 0) continue;
+            if (case_dynamic(word)) {
+                alts[nalts++] = (CaseAlt){ NULL, arena_strdup(arena, word), i };
+                continue;
+            }
+            GlobPat *pat = pattern_compile(arena, word);
+            if (!pat) continue;
+            const char *lit = pattern_literal(pat);
+            if (lit) {
+                lits[nkeys] = lit;
+                lit_arms[nkeys++] = i;
+            } else {
+                alts[nalts++] = (CaseAlt){ pat, NULL, i };
+            }
         }
-        return n;
     }
-    return 0;
+    t->alts = alts;
+    t->nalts = nalts;
+    if (nkeys) {
+        unsigned size = 8;
+        while (size < (unsigned)nkeys * 2) size *= 2;
+        t->keys = arena_calloc(arena, size * sizeof(char *));
+        t->arms = arena_alloc(arena, size * sizeof(int));
+        if (!t->keys || !t->arms) goto done;
+        t->mask = size - 1;
+        for (int i = 0; i < nkeys; i++) {
+            unsigned h = case_hash(lits[i]) & t->mask;
+            while (t->keys[h] && strcmp(t->keys[h], lits[i]) != 0) h = (h + 1) & t->mask;
+            if (!t->keys[h]) {
+                t->keys[h] = lits[i];
+                t->arms[h] = lit_arms[i];
+            }
+        }
+    }
+    node->case_stmt.table = t;
+
+done:
+    for (int i = 0; i < narms; i++) argv_clear(&lists[i]);
+    free(lists);
+    free(lits);
+    free(lit_arms);
+}
+
+// Expands one word as if it were double quoted: no field splitting, and
+// a * in a value is just a *.
+static char *expand_word(const char *raw) {
+    ArgVec args;
+    argv_init(&args);
+    split_args(raw, &args);
+    const char *w = args.n ? args.v[0] : "";
+    char *quoted = malloc(strlen(w) + 3), *q = quoted;
+    if (!quoted) {
+        argv_clear(&args);
+        return NULL;
+    }
+    *q++ = '\x06';
+    for (; *w; w++)
+        if (*w != '\x06' && *w != '\x07') *q++ = *w;
+    *q++ = '\x07';
+    *q = '\0';
+    argv_clear(&args);
+    char *word = expand_variables(quoted);
+    free(quoted);
+    if (word) quote_removal(&word, 1);
+    return word;
+}
+
+static bool case_alt_match(const CaseAlt *alt, const char *word) {
+    if (alt->pat) return pattern_match(alt->pat, word);
+    char *text = expand_variables(alt->text);
+    if (!text) return false;
+    for (char *p = text; *p; p++)
+        if (*p == '\x11') *p = ' ';
+    Arena arena;
+    arena_init(&arena);
+    GlobPat *pat = pattern_compile(&arena, text);
+    bool match = pat && pattern_match(pat, word);
+    arena_release(&arena);
+    free(text);
+    return match;
+}
+
+int case_select(ASTNode *node) {
+    const CaseTable *t = node->case_stmt.table;
+    if (!t) return -1;
+    char *word = expand_word(node->case_stmt.word);
+    if (!word) return -1;
+    int arm = node->case_stmt.narms;
+    if (t->keys) {
+        unsigned h = case_hash(word) & t->mask;
+        for (; t->keys[h]; h = (h + 1) & t->mask) {
+            if (strcmp(t->keys[h], word) == 0) {
+                arm = t->arms[h];
+                break;
+            }
+        }
+    }
+    // Only arms before the literal one can still win.
+    for (int i = 0; i < t->nalts && t->alts[i].arm < arm; i++) {
+        if (case_alt_match(&t->alts[i], word)) {
+            arm = t->alts[i].arm;
+            break;
+        }
+    }
+    free(word);
+    return arm < node->case_stmt.narms ? arm : -1;
+}
+
+// The list is split into words first, so quotes are known when the
+// words are expanded, as they are for a command.
+static void split_for_list(ASTNode *node, ArgVec *args) {
+    if (!node->for_loop.list) return;
+    split_args(node->for_loop.list, args);
+    expand_words(args);
+}
+
+static void glob_for_list(ArgVec *args) {
+    GlobCache *cache = NULL;
+    expand_glob(args, &cache);
+    glob_cache_free(cache);
+    quote_removal(args->v, args->n);
+}
+
+void expand_for_list(ASTNode *node, ArgVec *args) {
+    split_for_list(node, args);
+    glob_for_list(args);
+}
+
+void for_iter_init(ForIter *it, ASTNode *node) {
+    memset(it, 0, sizeof(*it));
+    const char *list = node->for_loop.list;
+    if (list && brace_range_word(list, &it->range)) {
+        it->lazy = true;
+        return;
+    }
+    ArgVec items;
+    argv_init(&items);
+    split_for_list(node, &items);
+    if (opt_nosortglob && items.n == 1 && glob_has_magic(items.v[0]) &&
+        (it->stream = glob_stream_open(items.v[0]))) {
+        argv_clear(&items);
+        return;
+    }
+    glob_for_list(&items);
+    it->items = argv_detach(&items, &it->count);
+}
+
+const char *for_iter_next(ForIter *it) {
+    if (it->lazy) return brace_range_next(&it->range, it->value, sizeof(it->value)) ? it->value : NULL;
+    if (it->stream) return glob_stream_next(it->stream);
+    return it->next < it->count ? it->items[it->next++] : NULL;
+}
+
+void for_iter_free(ForIter *it) {
+    glob_stream_close(it->stream);
+    it->stream = NULL;
+    if (!it->items) return;
+    free_args(it->items, it->count);
+    free(it->items);
+    it->items = NULL;
+}
+
+// for -j N: each iteration runs in a forked child, at most N at a time,
+// and its output is held back until every earlier iteration's has been
+// written. break and continue only end the iteration they are in, and
+// assignments stay in the child. The status is that of the first
+// iteration, in list order, that failed.
+int for_parallel(ASTNode *node) {
+    char *arg = expand_word(node->for_loop.jobs);
+    int jobs = arg ? pool_size(arg) : -1;
+    if (jobs < 0) {
+        fprintf(stderr, "cvx: for: %s: invalid job count\n", arg ? arg : "");
+        free(arg);
+        return last_exit_status = 1;
+    }
+    free(arg);
+
+    JobPool *pool = pool_new(jobs, POOL_CAPTURE | POOL_ORDERED);
+    if (!pool) return last_exit_status = 1;
+    ForIter it;
+    for_iter_init(&it, node);
+    const char *value;
+    int out_fd, err_fd;
+    while (!sigint_received && (value = for_iter_next(&it)) != NULL &&
+           pool_next(pool, &out_fd, &err_fd)) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            pool_child(pool, out_fd, err_fd);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            vars_set(node->for_loop.var, value);
+            int status = execute_parsed(node->for_loop.body);
+            out_flush();
+            exit(status);
+        }
+        if (pid < 0) perror("fork");
+        pool_started(pool, pid);
+    }
+    for_iter_free(&it);
+    return last_exit_status = pool_finish(pool);
+}
+
+// Status of (( expr )): 0 when the value is non-zero, 1 when it is zero
+// or the expression fails.
+int arith_status(const char *expr) {
+    long v;
+    last_exit_status = (evaluate_arithmetic(expr, &v) && v != 0) ? 0 : 1;
+    return last_exit_status;
 }
 
 int execute_ast(ASTNode *node, bool background) {
+    while (node && node->type == AST_SEQUENCE) {
+        execute_ast(node->binary.left, false);
+        if (loop_control != 0 || sigint_received) return 0;
+        node = node->binary.right;
+    }
     if (!node) return 0;
 
     switch (node->type) {
-        case AST_SEQUENCE: {
-            execute_ast(node->left, false);
-            if (loop_control != 0 || sigint_received) return 0;
-            return execute_ast(node->right, background);
-        }
         case AST_BACKGROUND: {
-            return execute_ast(node->left, true);
+            return execute_ast(node->unary.body, true);
         }
         case AST_AND: {
-            int status = execute_ast(node->left, false);
+            int status = execute_ast(node->binary.left, false);
             if (loop_control != 0 || sigint_received) return 0;
             if (status == 0) {
-                return execute_ast(node->right, background);
+                return execute_ast(node->binary.right, background);
             }
             return status;
         }
         case AST_OR: {
-            int status = execute_ast(node->left, false);
+            int status = execute_ast(node->binary.left, false);
             if (loop_control != 0 || sigint_received) return 0;
             if (status != 0) {
-                return execute_ast(node->right, background);
+                return execute_ast(node->binary.right, background);
             }
             return status;
         }
         case AST_PIPELINE: {
-            char *cmds[64];
-            int n = get_pipeline_cmds(node, cmds, 64);
-            return execute_pipeline(cmds, n, background);
+            return execute_pipeline_node(node, background);
         }
         case AST_COMMAND: {
-            return exec_command(node->cmd, background);
+            return exec_node(node, background);
         }
         case AST_FUNCDEF: {
-            add_function(node->name, node->cmd);
+            add_function(node->funcdef.name, node->funcdef.body);
             return 0;
         }
-        case AST_IF_BODY:
-        case AST_CASE_ITEM:
-            return 0;
         case AST_IF: {
-            int status = execute_ast(node->cond, false);
+            int status = execute_ast(node->if_stmt.cond, false);
             if (loop_control != 0 || sigint_received) return 0;
             if (status == 0) {
-                return execute_ast(node->left, background);
-            } else if (node->right) {
-                return execute_ast(node->right, background);
+                return execute_ast(node->if_stmt.then_branch, background);
+            } else if (node->if_stmt.else_branch) {
+                return execute_ast(node->if_stmt.else_branch, background);
             }
             return 0;
         }
         case AST_CASE: {
-            char *expanded_word = expand_variables(node->cmd);
-            ASTNode *item = node->left;
-            while (item) {
-                bool match = false;
-                char *expanded_pattern = expand_variables(item->cmd);
-                if (strcmp(expanded_pattern, "*") == 0) match = true;
-                else {
-                    char *p_copy = strdup(expanded_pattern);
-                    char *tok = strtok(p_copy, "|");
-                    while (tok) {
-                        while (*tok == ' ') tok++;
-                        char *end = tok + strlen(tok) - 1;
-                        while (end > tok && *end == ' ') { *end = '\0'; end--; }
-                        if (strcmp(tok, expanded_word) == 0) { match = true; break; }
-                        tok = strtok(NULL, "|");
-                    }
-                    free(p_copy);
-                }
-                free(expanded_pattern);
-                
-                if (match) {
-                    free(expanded_word);
-                    return execute_ast(item->left, background);
-                }
-                item = item->right;
-            }
-            free(expanded_word);
+            int arm = case_select(node);
+            if (arm >= 0) return execute_ast(node->case_stmt.arms[arm].body, background);
             return 0;
         }
         case AST_WHILE: {
             int status = 0;
-            while (execute_ast(node->cond, false) == 0) {
+            while (execute_ast(node->loop.cond, false) == 0) {
                 if (sigint_received) break;
-                status = execute_ast(node->left, background);
+                status = execute_ast(node->loop.body, background);
                 if (loop_control == 1) { loop_control = 0; break; }
                 if (loop_control == 2) { loop_control = 0; continue; }
                 if (sigint_received) break;
@@ -139,9 +380,9 @@ int execute_ast(ASTNode *node, bool background) {
         }
         case AST_UNTIL: {
             int status = 0;
-            while (execute_ast(node->cond, false) != 0) {
+            while (execute_ast(node->loop.cond, false) != 0) {
                 if (sigint_received) break;
-                status = execute_ast(node->left, background);
+                status = execute_ast(node->loop.body, background);
                 if (loop_control == 1) { loop_control = 0; break; }
                 if (loop_control == 2) { loop_control = 0; continue; }
                 if (sigint_received) break;
@@ -149,32 +390,46 @@ int execute_ast(ASTNode *node, bool background) {
             return status;
         }
         case AST_FOR: {
+            if (node->for_loop.jobs) return for_parallel(node);
             int status = 0;
-            char *list_expanded = node->cmd ? expand_variables(node->cmd) : strdup("");
-            char *args[256];
-            int count = split_args(list_expanded, args, 256);
-            free(list_expanded);
-            
-            expand_glob(args, &count, 256);
-            quote_removal(args, count);
-            
-            for (int i = 0; i < count; i++) {
+            ForIter it;
+            for_iter_init(&it, node);
+
+            const char *value;
+            while ((value = for_iter_next(&it)) != NULL) {
                 if (sigint_received) break;
-                setenv(node->name, args[i], 1);
-                status = execute_ast(node->left, background);
+                vars_set(node->for_loop.var, value);
+                status = execute_ast(node->for_loop.body, background);
                 if (loop_control == 1) { loop_control = 0; break; }
                 if (loop_control == 2) { loop_control = 0; continue; }
                 if (sigint_received) break;
             }
-            
-            free_args(args, count);
+
+            for_iter_free(&it);
+            return status;
+        }
+        case AST_ARITH:
+            return arith_status(node->arith.expr);
+        case AST_ARITH_FOR: {
+            int status = 0;
+            if (node->arith_for.init) arith_status(node->arith_for.init);
+            for (;;) {
+                if (sigint_received) break;
+                if (node->arith_for.cond && arith_status(node->arith_for.cond) != 0) break;
+                status = execute_ast(node->arith_for.body, background);
+                if (loop_control == 1) { loop_control = 0; break; }
+                if (loop_control == 2) loop_control = 0;
+                if (sigint_received) break;
+                if (node->arith_for.step) arith_status(node->arith_for.step);
+            }
             return status;
         }
         case AST_NEGATION: {
-            last_exit_status = (execute_ast(node->left, background) == 0 ? 1 : 0);
+            last_exit_status = (execute_ast(node->unary.body, background) == 0 ? 1 : 0);
             return last_exit_status;
         }
         case AST_SUBSHELL: {
+            out_flush();
             pid_t pid = fork();
             if (pid < 0) {
                 perror("fork");
@@ -184,7 +439,7 @@ int execute_ast(ASTNode *node, bool background) {
                 
                 signal(SIGINT, SIG_DFL);
                 signal(SIGTSTP, SIG_DFL);
-                int status = execute_ast(node->left, false);
+                int status = execute_ast(node->unary.body, false);
                 exit(status);
             }
             
@@ -7,6 +7,9 @@
 #define AST_H
 
 #include <stdbool.h>
+#include "brace.h"
+#include "utils.h"
+#include "fileglob.h"
 
 typedef enum {
     AST_COMMAND,
@@ -17,26 +20,84 @@ typedef enum {
     AST_BACKGROUND,
     AST_FUNCDEF,
     AST_IF,
-    AST_IF_BODY,
     AST_CASE,
-    AST_CASE_ITEM,
     AST_FOR,
     AST_WHILE,
     AST_UNTIL,
     AST_NEGATION,
-    AST_SUBSHELL
+    AST_SUBSHELL,
+    AST_ARITH,
+    AST_ARITH_FOR
 } ASTNodeType;
 
+// Command words are split once at parse time. WORD_LITERAL words have
+// their quotes removed already and go into argv as they are; the others
+// keep the split_args() markers and are expanded on every execution.
+typedef enum {
+    WORD_LITERAL = 0,
+    WORD_PARAM = 1,
+    WORD_GLOB = 2,
+    WORD_CMDSUB = 4,
+    WORD_BRACE = 8,
+    WORD_ARITH = 16
+} WordFlags;
+
+typedef struct {
+    char *text;
+    unsigned char flags;
+} Word;
+
+typedef struct {
+    char *pattern;
+    struct ASTNode *body;
+} CaseArm;
+
+// The compiled patterns of a case statement. Plain words are hashed, so
+// a case with many literal arms picks its arm in one lookup.
+typedef struct CaseTable CaseTable;
+
+// Nodes, and everything they point to, live in the arena passed to
+// parse_ast() and are freed together with it. Each node type only
+// carries the fields it uses.
 typedef struct ASTNode {
     ASTNodeType type;
-    char *cmd;
-    char *name;
-    struct ASTNode *left;
-    struct ASTNode *right;
-    struct ASTNode *cond;
+    union {
+        struct { char *text; Word *words; int nwords; } command;
+        struct { struct ASTNode *left; struct ASTNode *right; } binary;
+        struct { struct ASTNode *body; } unary;
+        struct { char *name; char *body; } funcdef;
+        struct { struct ASTNode *cond; struct ASTNode *then_branch; struct ASTNode *else_branch; } if_stmt;
+        struct { char *word; CaseArm *arms; int narms; CaseTable *table; } case_stmt;
+        struct { char *var; char *list; struct ASTNode *body; char *jobs; } for_loop;
+        struct { struct ASTNode *cond; struct ASTNode *body; } loop;
+        struct { char *expr; } arith;
+        struct { char *init; char *cond; char *step; struct ASTNode *body; } arith_for;
+    };
 } ASTNode;
 
-void free_ast(ASTNode *node);
 int execute_ast(ASTNode *node, bool background);
+int execute_pipeline_node(ASTNode *node, bool background);
+void case_compile(Arena *arena, ASTNode *node);
+int case_select(ASTNode *node);
+void expand_for_list(ASTNode *node, ArgVec *args);
+
+// Walks the values of a for list. A list that is one {A..B..S} sequence
+// is counted as it goes and never expanded as a whole, and so is a list
+// that is one glob over one directory when nosortglob is set.
+typedef struct {
+    char **items;
+    int count;
+    int next;
+    bool lazy;
+    GlobStream *stream;
+    BraceRange range;
+    char value[32];
+} ForIter;
+
+void for_iter_init(ForIter *it, ASTNode *node);
+const char *for_iter_next(ForIter *it);
+void for_iter_free(ForIter *it);
+int for_parallel(ASTNode *node);
+int arith_status(const char *expr);
 
 #endif
@@ -0,0 +1,262 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "brace.h"
+
+// Endpoints longer than this could overflow when a step is added.
+#define RANGE_MAX_DIGITS 18
+
+typedef struct {
+    char **v;
+    int n;
+    int cap;
+} WordVec;
+
+static void vec_push(WordVec *w, char *s) {
+    if (!s) return;
+    if (w->n + 1 >= w->cap) {
+        int cap = w->cap ? w->cap * 2 : 8;
+        char **v = realloc(w->v, cap * sizeof(char *));
+        if (!v) {
+            free(s);
+            return;
+        }
+        w->v = v;
+        w->cap = cap;
+    }
+    w->v[w->n++] = s;
+    w->v[w->n] = NULL;
+}
+
+// Returns the end of the quoted or escaped span opening at p, or p itself
+// when nothing opens there. Both raw quotes and split_args() markers count.
+static const char *skip_quoted(const char *p) {
+    const char *q;
+    switch (*p) {
+        case '\\':
+        case '\x10':
+            return p[1] ? p + 2 : p + 1;
+        case '\'':
+            q = strchr(p + 1, '\'');
+            return q ? q + 1 : p + strlen(p);
+        case '"':
+            for (q = p + 1; *q && *q != '"'; q++)
+                if (*q == '\\' && q[1]) q++;
+            return *q ? q + 1 : q;
+        case '\x04':
+            q = strchr(p + 1, '\x05');
+            return q ? q + 1 : p + strlen(p);
+        case '\x06':
+            q = strchr(p + 1, '\x07');
+            return q ? q + 1 : p + strlen(p);
+        default:
+            return p;
+    }
+}
+
+// Returns the end of the ${...} or $(...) opening at p, or p itself.
+static const char *skip_dollar(const char *p) {
+    if (*p != '$' || (p[1] != '{' && p[1] != '(')) return p;
+    char open = p[1], close = open == '{' ? '}' : ')';
+    int depth = 0;
+    const char *q = p + 1;
+    while (*q) {
+        const char *e = skip_quoted(q);
+        if (e != q) {
+            q = e;
+            continue;
+        }
+        if (*q == open) depth++;
+        else if (*q == close && --depth == 0) return q + 1;
+        q++;
+    }
+    return q;
+}
+
+static const char *skip_span(const char *p) {
+    const char *e = skip_quoted(p);
+    return e != p ? e : skip_dollar(p);
+}
+
+// Reads an integer or a single letter ending at a ".." or at end.
+static bool parse_endpoint(const char *s, const char *end, const char **stop,
+                           long *v, bool *alpha, bool *padded) {
+    const char *p = s;
+    if (p < end && isalpha((unsigned char)*p) && (p + 1 == end || p[1] == '.')) {
+        *v = (unsigned char)*p;
+        *alpha = true;
+        *padded = false;
+        *stop = p + 1;
+        return true;
+    }
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    const char *digits = p;
+    while (p < end && isdigit((unsigned char)*p)) p++;
+    if (p == digits || p - digits > RANGE_MAX_DIGITS) return false;
+    *v = strtol(s, NULL, 10);
+    *alpha = false;
+    *padded = digits[0] == '0' && p - digits > 1;
+    *stop = p;
+    return true;
+}
+
+// Parses the text between the braces of a sequence expression.
+bool brace_range_parse(const char *s, size_t len, BraceRange *r) {
+    const char *end = s + len, *p;
+    long a, b, step = 1;
+    bool alpha_a, alpha_b, pad_a, pad_b;
+    if (!parse_endpoint(s, end, &p, &a, &alpha_a, &pad_a)) return false;
+    size_t wa = p - s;
+    if (end - p < 2 || p[0] != '.' || p[1] != '.') return false;
+    const char *sb = p + 2;
+    if (!parse_endpoint(sb, end, &p, &b, &alpha_b, &pad_b) || alpha_a != alpha_b) return false;
+    size_t wb = p - sb;
+    if (p < end) {
+        bool alpha_s, pad_s;
+        if (end - p < 3 || p[0] != '.' || p[1] != '.') return false;
+        if (!parse_endpoint(p + 2, end, &p, &step, &alpha_s, &pad_s) || alpha_s || p != end)
+            return false;
+    }
+    if (step < 0) step = -step;
+    if (step == 0) step = 1;
+    r->cur = a;
+    r->last = b;
+    r->step = a <= b ? step : -step;
+    r->width = (pad_a || pad_b) ? (int)(wa > wb ? wa : wb) : 0;
+    r->alpha = alpha_a;
+    r->done = false;
+    return true;
+}
+
+bool brace_range_next(BraceRange *r, char *buf, size_t size) {
+    if (r->done) return false;
+    if (r->alpha) snprintf(buf, size, "%c", (int)r->cur);
+    else snprintf(buf, size, "%0*ld", r->width, r->cur);
+    if (r->step > 0 ? r->last - r->cur < r->step : r->cur - r->last < -r->step) r->done = true;
+    else r->cur += r->step;
+    return true;
+}
+
+// True when the whole word is one sequence expression, such as a for
+// list that can be counted without being expanded.
+bool brace_range_word(const char *word, BraceRange *r) {
+    size_t len = strlen(word);
+    return len > 2 && word[0] == '{' && word[len - 1] == '}' &&
+           brace_range_parse(word + 1, len - 2, r);
+}
+
+bool has_braces(const char *word) {
+    for (const char *p = word; *p; p++)
+        if (*p == '{' && (p == word || p[-1] != '$')) return strchr(p, '}') != NULL;
+    return false;
+}
+
+// Finds the first brace pair at or after from that expands: one with a
+// comma at its own level, or a valid sequence.
+static bool find_brace(const char *word, size_t from, size_t *open, size_t *close, bool *comma) {
+    const char *p = word + from;
+    while (*p) {
+        const char *e = skip_span(p);
+        if (e != p) {
+            p = e;
+            continue;
+        }
+        if (*p != '{') {
+            p++;
+            continue;
+        }
+        int depth = 0;
+        bool has_comma = false;
+        const char *q = p;
+        while (*q) {
+            e = skip_span(q);
+            if (e != q) {
+                q = e;
+                continue;
+            }
+            if (*q == '{') depth++;
+            else if (*q == '}' && --depth == 0) break;
+            else if (*q == ',' && depth == 1) has_comma = true;
+            q++;
+        }
+        BraceRange r;
+        if (*q == '}' && (has_comma || brace_range_parse(p + 1, q - p - 1, &r))) {
+            *open = p - word;
+            *close = q - word;
+            *comma = has_comma;
+            return true;
+        }
+        p++;
+    }
+    return false;
+}
+
+static void expand_into(WordVec *out, const char *word, size_t from);
+
+static void expand_joined(WordVec *out, const char *word, size_t open,
+                          const char *mid, size_t mlen, const char *suffix) {
+    size_t slen = strlen(suffix);
+    char *s = malloc(open + mlen + slen + 1);
+    if (!s) return;
+    memcpy(s, word, open);
+    memcpy(s + open, mid, mlen);
+    memcpy(s + open + mlen, suffix, slen + 1);
+    expand_into(out, s, open);
+    free(s);
+}
+
+// The prefix before the first expanding brace cannot expand, so each
+// result is only rescanned from where the alternative was put in.
+static void expand_into(WordVec *out, const char *word, size_t from) {
+    size_t open, close;
+    bool comma;
+    if (!find_brace(word, from, &open, &close, &comma)) {
+        // Like bash, an alternative that leaves the word empty drops it.
+        if (*word) vec_push(out, strdup(word));
+        return;
+    }
+    const char *suffix = word + close + 1;
+    if (!comma) {
+        BraceRange r;
+        char buf[32];
+        brace_range_parse(word + open + 1, close - open - 1, &r);
+        while (brace_range_next(&r, buf, sizeof(buf)))
+            expand_joined(out, word, open, buf, strlen(buf), suffix);
+        return;
+    }
+
+    const char *alt = word + open + 1, *p = alt, *end = word + close;
+    int depth = 0;
+    while (p <= end) {
+        const char *e = skip_span(p);
+        if (e != p) {
+            p = e;
+            continue;
+        }
+        if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && depth > 0) {
+            depth--;
+        } else if (p == end || (*p == ',' && depth == 0)) {
+            expand_joined(out, word, open, alt, p - alt, suffix);
+            alt = p + 1;
+        }
+        p++;
+    }
+}
+
+// Returns the NULL-terminated expansions of word, which is the only one
+// when it has no braces to expand. There may be none, as for {,}.
+char **brace_expand(const char *word, int *count) {
+    WordVec out = { 0 };
+    expand_into(&out, word, 0);
+    if (!out.v) out.v = calloc(1, sizeof(char *));
+    *count = out.n;
+    return out.v;
+}
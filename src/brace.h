@@ -0,0 +1,34 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef BRACE_H
+#define BRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A {A..B} or {A..B..S} sequence, produced one value at a time. The
+// bounds are integers, zero-padded when either is written with a leading
+// zero, or single letters.
+typedef struct {
+    long cur;
+    long last;
+    long step;
+    int width;
+    bool alpha;
+    bool done;
+} BraceRange;
+
+bool brace_range_parse(const char *s, size_t len, BraceRange *r);
+bool brace_range_next(BraceRange *r, char *buf, size_t size);
+bool brace_range_word(const char *word, BraceRange *r);
+
+// Brace expansion runs before any other expansion and only looks at
+// unquoted braces, in raw text or in split_args() output. ${...} and
+// $(...) are left alone.
+bool has_braces(const char *word);
+char **brace_expand(const char *word, int *count);
+
+#endif
@@ -0,0 +1,177 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "builtins.h"
+#include "commands.h"
+#include "functions.h"
+#include "cmdhash.h"
+#include "config.h"
+#include "lexer.h"
+#include "exec.h"
+#include "out.h"
+
+// Runs a builtin and writes out whatever it buffered.
+int builtin_run(const Builtin *b, int argc, char **argv) {
+    int status = b->fn(argc, argv);
+    out_flush();
+    return status;
+}
+
+static int builtin_break(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    loop_control = 1;
+    return 0;
+}
+
+static int builtin_continue(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    loop_control = 2;
+    return 0;
+}
+
+static int builtin_true(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    return 0;
+}
+
+#define S BUILTIN_SPECIAL
+#define P BUILTIN_PARENT_OK
+#define O BUILTIN_STDOUT
+#define R BUILTIN_REDIRECT
+#define U BUILTIN_UNDOABLE
+
+// Perfect hash over the builtin names: (2 * first + 5 * last + 8 * len)
+// & 63 is collision free for this set, so a lookup costs one strcmp.
+// Adding a builtin means re-checking that, or picking new multipliers.
+static const Builtin builtin_table[64] = {
+    [1]  = { "type",      cmd_type,         P | O | R },
+    [2]  = { "set",       cmd_set,          S | R },
+    [3]  = { "break",     builtin_break,    S | R | U },
+    [5]  = { "[",         cmd_bracket,      P | R },
+    [6]  = { "eval",      cmd_eval,         S | R },
+    [10] = { "cd",        cmd_cd,           R },
+    [12] = { "test",      cmd_test,         P | R },
+    [14] = { "printf",    cmd_printf,       P | O | R },
+    [18] = { "shopt",     cmd_shopt,        O | R },
+    [19] = { "functions", cmd_functions,    P | O | R },
+    [21] = { "echo",      cmd_echo,         P | O | R },
+    [23] = { "bg",        cmd_bg,           0 },
+    [25] = { "exec",      cmd_exec,         S },
+    [30] = { ":",         builtin_true,     S | P | R },
+    [31] = { "fg",        cmd_fg,           0 },
+    [32] = { "help",      cmd_help,         P | O | R },
+    [33] = { "unalias",   cmd_unalias,      R },
+    [37] = { "history",   cmd_history,      P | O | R },
+    [39] = { "ls",        cmd_ls,           P | O | R },
+    [41] = { "alias",     cmd_alias,        O | R },
+    [44] = { "pwd",       cmd_pwd,          P | O | R },
+    [46] = { "exit",      cmd_exit,         S | R },
+    [47] = { "delfunc",   cmd_delfunc,      R },
+    [48] = { "pmap",      cmd_pmap,         R },
+    [50] = { "command",   cmd_command,      O | R },
+    [51] = { "jobs",      cmd_jobs,         P | O | R },
+    [56] = { "hash",      cmd_hash,         O | R },
+    [62] = { "export",    cmd_export,       S | R | U },
+    [63] = { "continue",  builtin_continue, S | R | U },
+};
+
+#undef S
+#undef P
+#undef O
+#undef R
+#undef U
+
+const Builtin *builtin_lookup(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0) return NULL;
+    unsigned h = (2u * (unsigned char)name[0] + 5u * (unsigned char)name[len - 1] + 8u * (unsigned)len) & 63;
+    const Builtin *b = &builtin_table[h];
+    if (b->name && strcmp(b->name, name) == 0) return b;
+    return NULL;
+}
+
+static const char *alias_value(const char *name) {
+    for (int i = 0; i < alias_count; i++)
+        if (strcmp(aliases[i].name, name) == 0) return aliases[i].command;
+    return NULL;
+}
+
+// Describes what name would run, in the order the shell looks it up.
+// verbose selects type's sentences over command -v's bare answers.
+static bool describe(const char *name, bool verbose) {
+    const char *alias = alias_value(name);
+    const Builtin *b = builtin_lookup(name);
+    const char *path;
+
+    if (alias) {
+        if (verbose) out_printf("%s is aliased to `%s'\n", name, alias);
+        else out_printf("alias %s='%s'\n", name, alias);
+    } else if (is_reserved_word(name)) {
+        if (verbose) out_printf("%s is a shell keyword\n", name);
+        else out_printf("%s\n", name);
+    } else if (has_function(name)) {
+        if (verbose) out_printf("%s is a function\n", name);
+        else out_printf("%s\n", name);
+    } else if (b) {
+        if (verbose) out_printf("%s is a %sshell builtin\n", name, (b->flags & BUILTIN_SPECIAL) ? "special " : "");
+        else out_printf("%s\n", name);
+    } else if ((path = cmdhash_lookup(name))) {
+        if (verbose) out_printf("%s is %s\n", name, path);
+        else out_printf("%s\n", path);
+    } else {
+        if (verbose) out_error("cvx: type: %s: not found\n", name);
+        return false;
+    }
+    return true;
+}
+
+int cmd_type(int argc, char **argv) {
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+        if (!describe(argv[i], true)) status = 1;
+    return status;
+}
+
+// command [-v|-V] name [args...]: with -v or -V, describes name; otherwise
+// runs it as a builtin or an external command, skipping functions.
+int cmd_command(int argc, char **argv) {
+    int i = 1;
+    bool brief = false, verbose = false;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        if (strcmp(argv[i], "-v") == 0) brief = true;
+        else if (strcmp(argv[i], "-V") == 0) verbose = true;
+        else {
+            out_error("command: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+    if (i >= argc) return 0;
+
+    if (brief || verbose) {
+        int status = 0;
+        for (; i < argc; i++)
+            if (!describe(argv[i], verbose)) status = 1;
+        return status;
+    }
+
+    const Builtin *b = builtin_lookup(argv[i]);
+    if (b) return builtin_run(b, argc - i, argv + i);
+
+    int n = argc - i;
+    char **args = malloc((n + 1) * sizeof(char *));
+    if (!args) return 1;
+    for (int k = 0; k < n; k++) args[k] = strdup(argv[i + k]);
+    args[n] = NULL;
+    int status = exec_external_args(args, n, argv[i], false);
+    free(args);
+    return status;
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stdbool.h>
+
+// POSIX special builtin.
+#define BUILTIN_SPECIAL   0x1
+// Running it in the shell process changes nothing but its output and
+// exit status, so it does not need a child of its own.
+#define BUILTIN_PARENT_OK 0x2
+// Writes its results to stdout.
+#define BUILTIN_STDOUT    0x4
+// Can run in the shell with redirections applied around the call.
+#define BUILTIN_REDIRECT  0x8
+// Only changes variables or loop control, which a caller running it in
+// place of a subshell can save and put back.
+#define BUILTIN_UNDOABLE  0x10
+
+typedef int (*builtin_fn)(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    builtin_fn fn;
+    unsigned flags;
+} Builtin;
+
+// The one table both execution paths dispatch through.
+const Builtin *builtin_lookup(const char *name);
+int builtin_run(const Builtin *b, int argc, char **argv);
+int cmd_type(int argc, char **argv);
+int cmd_command(int argc, char **argv);
+
+#endif
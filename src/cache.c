@@ -0,0 +1,579 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include "cache.h"
+#include "parser.h"
+#include "script.h"
+#include "vars.h"
+
+// Bump whenever the record encoding or the AST layout changes; entries
+// written by another version are treated as misses.
+#define CACHE_VERSION 6
+#define CACHE_MAGIC "CVXC"
+#define CACHE_SUFFIX ".cvxc"
+#define NODE_NULL 0xff
+#define STR_NULL 0xffffffffu
+#define CACHE_DROP_BYTES (1 << 20)
+
+bool script_cache_enabled = false;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t size;
+    uint64_t hash;
+    uint32_t path_len;
+} CacheHeader;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buf;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    Arena *arena;
+    bool bad;
+} Reader;
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#define FNV_OFFSET 14695981039346656037ULL
+
+static bool cache_dir(char *out, size_t size) {
+    const char *xdg = vars_get("XDG_CACHE_HOME");
+    char base[PATH_MAX];
+    if (xdg && *xdg) {
+        snprintf(base, sizeof(base), "%s", xdg);
+    } else {
+        const char *home = vars_get("HOME");
+        if (!home || !*home) return false;
+        snprintf(base, sizeof(base), "%s/.cache", home);
+    }
+    mkdir(base, 0700);
+    if ((size_t)snprintf(out, size, "%s/cvx", base) >= size) return false;
+    if (mkdir(out, 0700) != 0 && access(out, W_OK) != 0) return false;
+    return true;
+}
+
+// ---- stats ----
+
+static void bump_stats(bool hit) {
+    char dir[PATH_MAX], path[PATH_MAX + 16];
+    if (!cache_dir(dir, sizeof(dir))) return;
+    snprintf(path, sizeof(path), "%s/stats", dir);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    if (flock(fd, LOCK_EX) == 0) {
+        char text[128] = {0};
+        unsigned long long hits = 0, misses = 0;
+        ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+        if (n > 0) sscanf(text, "hits %llu misses %llu", &hits, &misses);
+        if (hit) hits++; else misses++;
+        int len = snprintf(text, sizeof(text), "hits %llu\nmisses %llu\n", hits, misses);
+        if (pwrite(fd, text, len, 0) == len) ftruncate(fd, len);
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+}
+
+void cache_print_stats(void) {
+    char dir[PATH_MAX], path[PATH_MAX + 16];
+    if (!cache_dir(dir, sizeof(dir))) {
+        fprintf(stderr, "cvx: cache: no cache directory\n");
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/stats", dir);
+
+    unsigned long long hits = 0, misses = 0;
+    FILE *f = fopen(path, "r");
+    if (f) {
+        if (fscanf(f, "hits %llu misses %llu", &hits, &misses) != 2) hits = misses = 0;
+        fclose(f);
+    }
+
+    int entries = 0;
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            size_t n = strlen(e->d_name);
+            if (e->d_name[0] != '.' && n > strlen(CACHE_SUFFIX) &&
+                strcmp(e->d_name + n - strlen(CACHE_SUFFIX), CACHE_SUFFIX) == 0) entries++;
+        }
+        closedir(d);
+    }
+
+    printf("cache:   %s\n", dir);
+    printf("hits:    %llu\n", hits);
+    printf("misses:  %llu\n", misses);
+    printf("entries: %d\n", entries);
+}
+
+// ---- encoding ----
+
+static void put(Buf *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len) cap *= 2;
+        char *grown = realloc(b->data, cap);
+        if (!grown) { perror("realloc"); exit(1); }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void put_u8(Buf *b, unsigned char v) { put(b, &v, 1); }
+static void put_u32(Buf *b, uint32_t v) { put(b, &v, sizeof(v)); }
+
+// Strings keep their terminator so a loaded entry can point straight
+// into the mapping.
+static void put_str(Buf *b, const char *s) {
+    if (!s) { put_u32(b, STR_NULL); return; }
+    uint32_t len = (uint32_t)strlen(s);
+    put_u32(b, len);
+    put(b, s, len + 1);
+}
+
+static void put_node(Buf *b, const ASTNode *n) {
+    while (n && n->type == AST_SEQUENCE) {
+        put_u8(b, AST_SEQUENCE);
+        put_node(b, n->binary.left);
+        n = n->binary.right;
+    }
+    if (!n) { put_u8(b, NODE_NULL); return; }
+
+    put_u8(b, (unsigned char)n->type);
+    switch (n->type) {
+        case AST_COMMAND:
+            put_str(b, n->command.text);
+            put_u32(b, (uint32_t)n->command.nwords);
+            for (int i = 0; i < n->command.nwords; i++) {
+                put_str(b, n->command.words[i].text);
+                put_u8(b, n->command.words[i].flags);
+            }
+            break;
+        case AST_PIPELINE:
+        case AST_AND:
+        case AST_OR:
+            put_node(b, n->binary.left);
+            put_node(b, n->binary.right);
+            break;
+        case AST_BACKGROUND:
+        case AST_NEGATION:
+        case AST_SUBSHELL:
+            put_node(b, n->unary.body);
+            break;
+        case AST_FUNCDEF:
+            put_str(b, n->funcdef.name);
+            put_str(b, n->funcdef.body);
+            break;
+        case AST_IF:
+            put_node(b, n->if_stmt.cond);
+            put_node(b, n->if_stmt.then_branch);
+            put_node(b, n->if_stmt.else_branch);
+            break;
+        case AST_CASE:
+            put_str(b, n->case_stmt.word);
+            put_u32(b, (uint32_t)n->case_stmt.narms);
+            for (int i = 0; i < n->case_stmt.narms; i++) {
+                put_str(b, n->case_stmt.arms[i].pattern);
+                put_node(b, n->case_stmt.arms[i].body);
+            }
+            break;
+        case AST_FOR:
+            put_str(b, n->for_loop.var);
+            put_str(b, n->for_loop.list);
+            put_str(b, n->for_loop.jobs);
+            put_node(b, n->for_loop.body);
+            break;
+        case AST_WHILE:
+        case AST_UNTIL:
+            put_node(b, n->loop.cond);
+            put_node(b, n->loop.body);
+            break;
+        case AST_ARITH:
+            put_str(b, n->arith.expr);
+            break;
+        case AST_ARITH_FOR:
+            put_str(b, n->arith_for.init);
+            put_str(b, n->arith_for.cond);
+            put_str(b, n->arith_for.step);
+            put_node(b, n->arith_for.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void put_record(FILE *f, CacheRecordKind kind, const Buf *payload) {
+    unsigned char k = (unsigned char)kind;
+    uint32_t len = payload ? (uint32_t)payload->len : 0;
+    fwrite(&k, 1, 1, f);
+    fwrite(&len, sizeof(len), 1, f);
+    if (len) fwrite(payload->data, 1, len, f);
+}
+
+// ---- decoding ----
+
+static const void *take(Reader *r, size_t len) {
+    if (r->bad || (size_t)(r->end - r->p) < len) {
+        r->bad = true;
+        return NULL;
+    }
+    const void *p = r->p;
+    r->p += len;
+    return p;
+}
+
+static unsigned char get_u8(Reader *r) {
+    const unsigned char *p = take(r, 1);
+    return p ? *p : NODE_NULL;
+}
+
+static uint32_t get_u32(Reader *r) {
+    uint32_t v = 0;
+    const void *p = take(r, sizeof(v));
+    if (p) memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static char *get_str(Reader *r) {
+    uint32_t len = get_u32(r);
+    if (r->bad || len == STR_NULL) return NULL;
+    char *s = (char *)take(r, (size_t)len + 1);
+    if (s && s[len] != '\0') r->bad = true;
+    return r->bad ? NULL : s;
+}
+
+static ASTNode *get_node(Reader *r) {
+    ASTNode *head = NULL;
+    ASTNode **slot = &head;
+
+    while (!r->bad) {
+        unsigned char type = get_u8(r);
+        if (type == NODE_NULL || r->bad) break;
+        if (type > AST_ARITH_FOR) { r->bad = true; break; }
+
+        ASTNode *n = arena_calloc(r->arena, sizeof(ASTNode));
+        if (!n) { r->bad = true; break; }
+        n->type = (ASTNodeType)type;
+        *slot = n;
+
+        if (n->type == AST_SEQUENCE) {
+            n->binary.left = get_node(r);
+            slot = &n->binary.right;
+            continue;
+        }
+
+        switch (n->type) {
+            case AST_COMMAND: {
+                n->command.text = get_str(r);
+                uint32_t nwords = get_u32(r);
+                if (r->bad || nwords > (uint32_t)(r->end - r->p)) { r->bad = true; break; }
+                n->command.nwords = (int)nwords;
+                n->command.words = arena_alloc(r->arena, (nwords ? nwords : 1) * sizeof(Word));
+                for (uint32_t i = 0; i < nwords; i++) {
+                    n->command.words[i].text = get_str(r);
+                    n->command.words[i].flags = get_u8(r);
+                }
+                break;
+            }
+            case AST_PIPELINE:
+            case AST_AND:
+            case AST_OR:
+                n->binary.left = get_node(r);
+                n->binary.right = get_node(r);
+                break;
+            case AST_BACKGROUND:
+            case AST_NEGATION:
+            case AST_SUBSHELL:
+                n->unary.body = get_node(r);
+                break;
+            case AST_FUNCDEF:
+                n->funcdef.name = get_str(r);
+                n->funcdef.body = get_str(r);
+                break;
+            case AST_IF:
+                n->if_stmt.cond = get_node(r);
+                n->if_stmt.then_branch = get_node(r);
+                n->if_stmt.else_branch = get_node(r);
+                break;
+            case AST_CASE: {
+                n->case_stmt.word = get_str(r);
+                uint32_t narms = get_u32(r);
+                if (r->bad || narms > (uint32_t)(r->end - r->p)) { r->bad = true; break; }
+                n->case_stmt.narms = (int)narms;
+                n->case_stmt.arms = arena_alloc(r->arena, (narms ? narms : 1) * sizeof(CaseArm));
+                for (uint32_t i = 0; i < narms; i++) {
+                    n->case_stmt.arms[i].pattern = get_str(r);
+                    n->case_stmt.arms[i].body = get_node(r);
+                }
+                if (!r->bad) case_compile(r->arena, n);
+                break;
+            }
+            case AST_FOR:
+                n->for_loop.var = get_str(r);
+                n->for_loop.list = get_str(r);
+                n->for_loop.jobs = get_str(r);
+                n->for_loop.body = get_node(r);
+                break;
+            case AST_WHILE:
+            case AST_UNTIL:
+                n->loop.cond = get_node(r);
+                n->loop.body = get_node(r);
+                break;
+            case AST_ARITH:
+                n->arith.expr = get_str(r);
+                break;
+            case AST_ARITH_FOR:
+                n->arith_for.init = get_str(r);
+                n->arith_for.cond = get_str(r);
+                n->arith_for.step = get_str(r);
+                n->arith_for.body = get_node(r);
+                break;
+            default:
+                break;
+        }
+        break;
+    }
+    return r->bad ? NULL : head;
+}
+
+// ---- entries ----
+
+static bool entry_path(const char *real, char *out, size_t size) {
+    char dir[PATH_MAX];
+    if (!cache_dir(dir, sizeof(dir))) return false;
+    uint64_t h = fnv1a(FNV_OFFSET, real, strlen(real));
+    return (size_t)snprintf(out, size, "%s/%016llx%s", dir, (unsigned long long)h, CACHE_SUFFIX) < size;
+}
+
+static bool hash_contents(int fd, uint64_t *hash) {
+    char buf[65536];
+    off_t off = 0;
+    *hash = FNV_OFFSET;
+    for (;;) {
+        ssize_t n = pread(fd, buf, sizeof(buf), off);
+        if (n < 0) return false;
+        if (n == 0) return true;
+        *hash = fnv1a(*hash, buf, (size_t)n);
+        off += n;
+    }
+}
+
+static void fill_header(CacheHeader *h, const struct stat *st, uint64_t hash, size_t path_len) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CACHE_MAGIC, 4);
+    h->version = CACHE_VERSION;
+    h->dev = (uint64_t)st->st_dev;
+    h->ino = (uint64_t)st->st_ino;
+    h->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    h->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    h->size = (uint64_t)st->st_size;
+    h->hash = hash;
+    h->path_len = (uint32_t)path_len;
+}
+
+// Entries are renamed into place only once complete, so checking for the
+// END record is enough to reject a truncated file; each record's framing
+// is checked again as it is decoded.
+static bool has_end_record(const char *p, const char *end) {
+    size_t tail = 1 + sizeof(uint32_t);
+    if ((size_t)(end - p) < tail) return false;
+    static const char end_record[1 + sizeof(uint32_t)] = { CACHE_END };
+    return memcmp(end - tail, end_record, tail) == 0;
+}
+
+static bool load_entry(const char *entry, const char *real, const CacheHeader *want, CacheImage *img) {
+    int fd = open(entry, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    size_t path_len = strlen(real);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader) + path_len) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    CacheHeader have;
+    memcpy(&have, map, sizeof(have));
+    const char *records = map + sizeof(CacheHeader) + path_len;
+    if (memcmp(&have, want, sizeof(have)) != 0 ||
+        memcmp(map + sizeof(CacheHeader), real, path_len) != 0 ||
+        !has_end_record(records, map + size)) {
+        munmap(map, size);
+        return false;
+    }
+
+    img->map = map;
+    img->size = size;
+    img->pos = sizeof(CacheHeader) + path_len;
+    return true;
+}
+
+static bool build_entry(const char *entry, const char *real, int fd, const CacheHeader *header) {
+    char tmp[PATH_MAX + 48];
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", entry);
+    int out = mkstemp(tmp);
+    if (out < 0) return false;
+    FILE *f = fdopen(out, "w");
+    if (!f) { close(out); unlink(tmp); return false; }
+
+    fwrite(header, sizeof(*header), 1, f);
+    fwrite(real, 1, header->path_len, f);
+
+    ScriptReader reader;
+    if (!script_reader_init(&reader, fd)) {
+        fclose(f);
+        unlink(tmp);
+        return false;
+    }
+
+    Buf payload = {0};
+    char *cmd;
+    while ((cmd = script_reader_next(&reader)) != NULL) {
+        payload.len = 0;
+        if (strstr(cmd, "<<") != NULL) {
+            put(&payload, cmd, strlen(cmd) + 1);
+            put_record(f, CACHE_TEXT, &payload);
+            continue;
+        }
+
+        if (strstr(cmd, "\\\n") != NULL) join_continuations(cmd);
+        Arena arena;
+        arena_init(&arena);
+        bool error = false;
+        ASTNode *ast = parse_ast_silent(cmd, &arena, &error);
+        if (ast) {
+            put_node(&payload, ast);
+            put_record(f, CACHE_AST, &payload);
+        } else if (error) {
+            // Re-parsed at run time so the error shows up in order.
+            put(&payload, cmd, strlen(cmd) + 1);
+            put_record(f, CACHE_TEXT, &payload);
+        }
+        arena_release(&arena);
+    }
+    put_record(f, CACHE_END, NULL);
+    free(payload.data);
+    script_reader_free(&reader);
+
+    // The script changed while it was being read; leave no entry.
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size == header->size &&
+              st.st_mtim.tv_sec == header->mtime_sec && st.st_mtim.tv_nsec == header->mtime_nsec;
+    if (fclose(f) != 0) ok = false;
+    if (ok && rename(tmp, entry) == 0) return true;
+    unlink(tmp);
+    return false;
+}
+
+// Looks up (or on a miss, builds) the entry for the script open on fd.
+// Returns false when the script has to be read directly; fd is then
+// positioned at its start.
+bool cache_open(const char *path, int fd, CacheImage *img) {
+    memset(img, 0, sizeof(*img));
+
+    char real[PATH_MAX], entry[PATH_MAX + 32];
+    struct stat st;
+    uint64_t hash;
+    if (!realpath(path, real) || !entry_path(real, entry, sizeof(entry)) ||
+        fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        !hash_contents(fd, &hash)) return false;
+
+    CacheHeader header;
+    fill_header(&header, &st, hash, strlen(real));
+
+    if (load_entry(entry, real, &header, img)) {
+        bump_stats(true);
+        return true;
+    }
+    bump_stats(false);
+
+    bool built = build_entry(entry, real, fd, &header);
+    lseek(fd, 0, SEEK_SET);
+    return built && load_entry(entry, real, &header, img);
+}
+
+// Decodes the next record. AST nodes are allocated from arena; strings,
+// and the text of CACHE_TEXT records, point into the mapping.
+CacheRecordKind cache_next(CacheImage *img, Arena *arena, ASTNode **ast, char **text) {
+    *ast = NULL;
+    *text = NULL;
+
+    Reader r = { img->map + img->pos, img->map + img->size, arena, false };
+    unsigned char kind = get_u8(&r);
+    uint32_t len = get_u32(&r);
+    if (r.bad || kind == CACHE_END) return CACHE_END;
+    if ((kind != CACHE_AST && kind != CACHE_TEXT) || len > (size_t)(r.end - r.p)) {
+        fprintf(stderr, "cvx: cache: corrupt entry\n");
+        return CACHE_END;
+    }
+
+    r.end = r.p + len;
+    img->pos = (size_t)(r.end - img->map);
+
+    // Records are used once, in order; hand the pages of the ones already
+    // run back so a long script does not stay resident.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t done = (size_t)(r.p - img->map) & ~(page - 1);
+    if (done >= img->dropped + CACHE_DROP_BYTES) {
+        madvise(img->map + img->dropped, done - img->dropped, MADV_DONTNEED);
+        img->dropped = done;
+    }
+    if (kind == CACHE_TEXT) {
+        if (len == 0 || r.p[len - 1] != '\0') {
+            fprintf(stderr, "cvx: cache: corrupt entry\n");
+            return CACHE_END;
+        }
+        *text = (char *)r.p;
+        return CACHE_TEXT;
+    }
+
+    *ast = get_node(&r);
+    if (!*ast) {
+        fprintf(stderr, "cvx: cache: corrupt entry\n");
+        return CACHE_END;
+    }
+    return CACHE_AST;
+}
+
+void cache_close(CacheImage *img) {
+    if (img->map) munmap(img->map, img->size);
+    img->map = NULL;
+}
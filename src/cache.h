@@ -0,0 +1,38 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ast.h"
+#include "arena.h"
+
+// Opt-in cache of parsed scripts under $XDG_CACHE_HOME/cvx. An entry is
+// tied to the script's path, device/inode, mtime, size and content hash
+// and holds one record per top-level command, either a serialized AST or
+// the raw text for commands that must be preprocessed at run time.
+typedef enum {
+    CACHE_END,
+    CACHE_AST,
+    CACHE_TEXT
+} CacheRecordKind;
+
+typedef struct {
+    char *map;
+    size_t size;
+    size_t pos;
+    size_t dropped;
+} CacheImage;
+
+extern bool script_cache_enabled;
+
+bool cache_open(const char *path, int fd, CacheImage *img);
+CacheRecordKind cache_next(CacheImage *img, Arena *arena, ASTNode **ast, char **text);
+void cache_close(CacheImage *img);
+void cache_print_stats(void);
+
+#endif
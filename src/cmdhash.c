@@ -0,0 +1,152 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cmdhash.h"
+#include "vars.h"
+#include "out.h"
+
+#define CMDHASH_BUCKETS 128
+
+typedef struct CmdEntry {
+    char *name;
+    char *path;
+    int hits;
+    struct CmdEntry *next;
+} CmdEntry;
+
+static CmdEntry *buckets[CMDHASH_BUCKETS];
+
+static unsigned bucket_of(const char *name) {
+    unsigned h = 2166136261u;
+    for (const char *p = name; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h & (CMDHASH_BUCKETS - 1);
+}
+
+void cmdhash_clear(void) {
+    for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+        while (buckets[i]) {
+            CmdEntry *e = buckets[i];
+            buckets[i] = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+        }
+    }
+}
+
+void cmdhash_forget(const char *name) {
+    CmdEntry **link = &buckets[bucket_of(name)];
+    for (CmdEntry *e = *link; e; link = &e->next, e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            return;
+        }
+    }
+}
+
+static char *search_path(const char *name) {
+    const char *path = vars_get("PATH");
+    if (!path) path = "/usr/local/bin:/usr/bin:/bin";
+
+    char full[PATH_MAX];
+    const char *p = path;
+    for (;;) {
+        const char *end = strchr(p, ':');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        int n = len ? snprintf(full, sizeof(full), "%.*s/%s", (int)len, p, name)
+                    : snprintf(full, sizeof(full), "./%s", name);
+        struct stat st;
+        if (n > 0 && (size_t)n < sizeof(full) && stat(full, &st) == 0 &&
+            S_ISREG(st.st_mode) && access(full, X_OK) == 0) {
+            return strdup(full);
+        }
+        if (!end) return NULL;
+        p = end + 1;
+    }
+}
+
+// Returns the full path of an external command, or NULL when it is not on
+// PATH. Names containing a slash are returned as they are. Misses are not
+// remembered, so a command installed after a failed lookup is found.
+const char *cmdhash_lookup(const char *name) {
+    if (!name || !*name) return NULL;
+    if (strchr(name, '/')) return name;
+
+    unsigned b = bucket_of(name);
+    for (CmdEntry *e = buckets[b]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    char *path = search_path(name);
+    if (!path) return NULL;
+    CmdEntry *e = calloc(1, sizeof(CmdEntry));
+    if (!e) {
+        free(path);
+        return NULL;
+    }
+    e->name = strdup(name);
+    e->path = path;
+    e->hits = 1;
+    e->next = buckets[b];
+    buckets[b] = e;
+    return e->path;
+}
+
+int cmd_hash(int argc, char **argv) {
+    int i = 1;
+    if (i < argc && strcmp(argv[i], "-r") == 0) {
+        cmdhash_clear();
+        return 0;
+    }
+    if (i < argc && strcmp(argv[i], "-d") == 0) {
+        for (i++; i < argc; i++) cmdhash_forget(argv[i]);
+        return 0;
+    }
+
+    if (i >= argc) {
+        bool any = false;
+        for (int b = 0; b < CMDHASH_BUCKETS; b++) {
+            for (CmdEntry *e = buckets[b]; e; e = e->next) {
+                if (!any) out_printf("hits\tcommand\n");
+                any = true;
+                out_printf("%4d\t%s\n", e->hits, e->path);
+            }
+        }
+        if (!any) out_printf("hash: hash table empty\n");
+        return 0;
+    }
+
+    int status = 0;
+    for (; i < argc; i++) {
+        if (strchr(argv[i], '/')) continue;
+        cmdhash_forget(argv[i]);
+        const char *path = cmdhash_lookup(argv[i]);
+        if (!path) {
+            out_error("hash: %s: not found\n", argv[i]);
+            status = 1;
+        } else {
+            // Seeding is not a use.
+            for (CmdEntry *e = buckets[bucket_of(argv[i])]; e; e = e->next)
+                if (strcmp(e->name, argv[i]) == 0) e->hits = 0;
+        }
+    }
+    return status;
+}
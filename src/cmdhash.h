@@ -0,0 +1,17 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+// Remembers where external commands were found on PATH, so a spawn does
+// not repeat the directory search.
+// Assigning PATH clears it.
+const char *cmdhash_lookup(const char *name);
+void cmdhash_forget(const char *name);
+void cmdhash_clear(void);
+int cmd_hash(int argc, char **argv);
+
+#endif
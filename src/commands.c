@@ -14,11 +14,15 @@
 #include <stdbool.h>
 #include "parser.h"
 #include "jobs.h"
+#include "vars.h"
+#include "cmdhash.h"
+#include "out.h"
 #include <signal.h>
 #include <termios.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <ctype.h>
+#include <errno.h>
 
 extern int last_exit_status;
 
@@ -36,22 +40,26 @@ static int parse_job_id(const char *arg) {
 
 static void print_with_escapes(const char *s, bool interpret) {
     if (!s) return;
+    if (!interpret) {
+        out_puts(s);
+        return;
+    }
     for (int i = 0; s[i]; i++) {
         if (interpret && s[i] == '\\' && s[i+1]) {
             i++;
             switch (s[i]) {
-                case 'n': putchar('\n'); break;
-                case 'r': putchar('\r'); break;
-                case 't': putchar('\t'); break;
-                case '\\': putchar('\\'); break;
-                case 'a': putchar('\a'); break;
-                case 'b': putchar('\b'); break;
-                case 'f': putchar('\f'); break;
-                case 'v': putchar('\v'); break;
-                default: putchar('\\'); putchar(s[i]); break;
+                case 'n': out_putc('\n'); break;
+                case 'r': out_putc('\r'); break;
+                case 't': out_putc('\t'); break;
+                case '\\': out_putc('\\'); break;
+                case 'a': out_putc('\a'); break;
+                case 'b': out_putc('\b'); break;
+                case 'f': out_putc('\f'); break;
+                case 'v': out_putc('\v'); break;
+                default: out_putc('\\'); out_putc(s[i]); break;
             }
         } else {
-            putchar(s[i]);
+            out_putc(s[i]);
         }
     }
 }
@@ -75,12 +83,145 @@ int cmd_echo(int argc, char **argv) {
 
     for (int i = start; i < argc; i++) {
         print_with_escapes(argv[i], interpret);
-        if (i < argc - 1) putchar(' ');
+        if (i < argc - 1) out_putc(' ');
     }
-    if (newline) putchar('\n');
+    if (newline) out_putc('\n');
     return 0;
 }
 
+// Writes one backslash escape of a printf format or %b argument and
+// returns how many characters after the backslash it used. Sets *stop for
+// \c, which ends all output.
+static int printf_escape(const char *s, bool *stop) {
+    switch (*s) {
+        case 'n': out_putc('\n'); return 1;
+        case 't': out_putc('\t'); return 1;
+        case 'r': out_putc('\r'); return 1;
+        case 'a': out_putc('\a'); return 1;
+        case 'b': out_putc('\b'); return 1;
+        case 'f': out_putc('\f'); return 1;
+        case 'v': out_putc('\v'); return 1;
+        case '\\': out_putc('\\'); return 1;
+        case '"': out_putc('"'); return 1;
+        case '\'': out_putc('\''); return 1;
+        case 'c': *stop = true; return 1;
+        case '\0': out_putc('\\'); return 0;
+    }
+    if (*s >= '0' && *s <= '7') {
+        int v = 0, n = 0;
+        while (n < 3 && s[n] >= '0' && s[n] <= '7') v = v * 8 + (s[n++] - '0');
+        out_putc(v);
+        return n;
+    }
+    out_putc('\\');
+    out_putc(*s);
+    return 1;
+}
+
+// Numeric arguments follow printf(1): a leading quote gives the code of
+// the next character; anything unparsable is an error but still prints 0.
+static long long printf_number(const char *arg, bool *bad) {
+    if (!arg || !*arg) return 0;
+    if (arg[0] == '\'' || arg[0] == '"') return (unsigned char)arg[1];
+    char *end;
+    errno = 0;
+    long long v = strtoll(arg, &end, 0);
+    if (*end || errno) {
+        out_error("printf: %s: invalid number\n", arg);
+        *bad = true;
+    }
+    return v;
+}
+
+int cmd_printf(int argc, char **argv) {
+    if (argc < 2) {
+        out_error("printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    const char *fmt = argv[1];
+    int arg = 2;
+    bool bad = false, stop = false;
+
+    // The format is reused while arguments remain, as printf(1) does.
+    do {
+        int first_arg = arg;
+        for (const char *p = fmt; *p && !stop; p++) {
+            if (*p == '\\') {
+                p += printf_escape(p + 1, &stop);
+                continue;
+            }
+            if (*p != '%') {
+                out_putc(*p);
+                continue;
+            }
+            if (p[1] == '%') {
+                out_putc('%');
+                p++;
+                continue;
+            }
+
+            char spec[32];
+            size_t n = 0;
+            spec[n++] = '%';
+            p++;
+            while (*p && strchr("-+ #0", *p) && n < 8) spec[n++] = *p++;
+            while (isdigit((unsigned char)*p) && n < 16) spec[n++] = *p++;
+            if (*p == '.') {
+                spec[n++] = *p++;
+                while (isdigit((unsigned char)*p) && n < 24) spec[n++] = *p++;
+            }
+
+            const char *val = arg < argc ? argv[arg++] : NULL;
+            switch (*p) {
+                case 's':
+                    spec[n++] = 's';
+                    spec[n] = '\0';
+                    out_printf(spec, val ? val : "");
+                    break;
+                case 'b':
+                    for (const char *b = val ? val : ""; *b && !stop; b++) {
+                        if (*b == '\\') b += printf_escape(b + 1, &stop);
+                        else out_putc(*b);
+                    }
+                    break;
+                case 'c':
+                    if (val && *val) out_putc(*val);
+                    break;
+                case 'd': case 'i':
+                    spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = 'd';
+                    spec[n] = '\0';
+                    out_printf(spec, printf_number(val, &bad));
+                    break;
+                case 'u': case 'o': case 'x': case 'X':
+                    spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = *p;
+                    spec[n] = '\0';
+                    out_printf(spec, (unsigned long long)printf_number(val, &bad));
+                    break;
+                case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': {
+                    spec[n++] = *p;
+                    spec[n] = '\0';
+                    char *end;
+                    double d = val ? strtod(val, &end) : 0.0;
+                    if (val && *end) {
+                        out_error("printf: %s: invalid number\n", val);
+                        bad = true;
+                    }
+                    out_printf(spec, d);
+                    break;
+                }
+                default:
+                    out_error("printf: %%%c: invalid directive\n", *p ? *p : ' ');
+                    return 1;
+            }
+            if (!*p) break;
+        }
+        if (arg == first_arg) break;
+    } while (arg < argc && !stop);
+
+    return bad ? 1 : 0;
+}
+
 int cmd_cd(int argc, char **argv) {
     char *target;
     char cwd[1024];
@@ -89,20 +230,20 @@ int cmd_cd(int argc, char **argv) {
     if (getcwd(cwd, sizeof(cwd)) == NULL) cwd[0] = '\0';
 
     if (argc < 2) {
-        target = getenv("HOME");
+        target = (char *)vars_get("HOME");
         if (!target) target = "/";
     } else if (strcmp(argv[1], "-") == 0) {
-        target = previous_dir[0] ? previous_dir : getenv("HOME");
+        target = previous_dir[0] ? previous_dir : (char *)vars_get("HOME");
         if (!target) target = "/";
-        printf("%s\n", target);
+        out_printf("%s\n", target);
     } else if (argv[1][0] == '~') {
-        char *home = getenv("HOME");
+        const char *home = vars_get("HOME");
         if (!home) home = "/";
         if (argv[1][1] == '/' || argv[1][1] == '\0') {
             snprintf(path, sizeof(path), "%s%s", home, argv[1] + 1);
             target = path;
         } else {
-            fprintf(stderr, "cd: unsupported format: %s\n", argv[1]);
+            out_error("cd: unsupported format: %s\n", argv[1]);
             return 1;
         }
     } else {
@@ -110,7 +251,7 @@ int cmd_cd(int argc, char **argv) {
     }
 
     if (chdir(target) != 0) {
-        perror("cd");
+        out_perror("cd");
         return 1;
     }
 
@@ -127,22 +268,22 @@ int cmd_pwd(int argc, char **argv) {
         if (strcmp(argv[i], "-P") == 0) physical = 1;
         else if (strcmp(argv[i], "-L") == 0) physical = 0;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0) {
-            printf("Usage: pwd [OPTION]...\n");
-            printf("Print the name of the current working directory.\n\n");
-            printf("Options:\n");
-            printf("  -L      print the logical current working directory (default)\n");
-            printf("  -P      print the physical current working directory (resolving symlinks)\n");
-            printf("      --help, -help, -h     display this help message\n");
+            out_printf("Usage: pwd [OPTION]...\n");
+            out_printf("Print the name of the current working directory.\n\n");
+            out_printf("Options:\n");
+            out_printf("  -L      print the logical current working directory (default)\n");
+            out_printf("  -P      print the physical current working directory (resolving symlinks)\n");
+            out_printf("      --help, -help, -h     display this help message\n");
             return 0;
         }
     }
 
     if (physical) {
         char real[1024];
-        if (realpath(current_dir, real)) printf("%s\n", real);
-        else perror("pwd -P error");
+        if (realpath(current_dir, real)) out_printf("%s\n", real);
+        else out_perror("pwd -P error");
     } else {
-        printf("%s\n", current_dir);
+        out_printf("%s\n", current_dir);
     }
 
     return 0;
@@ -150,7 +291,7 @@ int cmd_pwd(int argc, char **argv) {
 
 int cmd_export(int argc, char **argv) {
     if (argc < 2) {
-        printf("export: usage: export VAR=value\n");
+        out_printf("export: usage: export VAR=value\n");
         return 1;
     }
 
@@ -158,11 +299,15 @@ int cmd_export(int argc, char **argv) {
         char *eq = strchr(argv[i], '=');
         if (eq) {
             *eq = '\0';
-            if (setenv(argv[i], eq + 1, 1) != 0) perror("export");
+            if (!is_valid_name(argv[i], strlen(argv[i]))) {
+                out_error("export: %s: not a valid identifier\n", argv[i]);
+                continue;
+            }
+            vars_export(argv[i], eq + 1);
+        } else if (vars_is_set(argv[i])) {
+            vars_export(argv[i], NULL);
         } else {
-            const char *val = getenv(argv[i]);
-            if (val) printf("%s=%s\n", argv[i], val);
-            else fprintf(stderr, "export: %s not set\n", argv[i]);
+            out_error("export: %s not set\n", argv[i]);
         }
     }
 
@@ -170,12 +315,12 @@ int cmd_export(int argc, char **argv) {
 }
 
 int cmd_history(int argc, char **argv) {
-    const char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     char path[1024];
     snprintf(path, sizeof(path), "%s/.cvx_history", home ? home : ".");
 
     FILE *f = fopen(path, "r");
-    if (!f) { perror("No history"); return 1; }
+    if (!f) { out_perror("No history"); return 1; }
 
     char lines[1024][1024];
     int count = 0;
@@ -190,45 +335,52 @@ int cmd_history(int argc, char **argv) {
         if (argv[1][1] == '-') index = count - atoi(argv[1]+2);
         else index = atoi(argv[1]+1) - 1;
         if (index >= 0 && index < count) {
-            printf("%s\n", lines[index]);
+            out_printf("%s\n", lines[index]);
         } else {
-            fprintf(stderr, "history: invalid index\n");
+            out_error("history: invalid index\n");
         }
         return 0;
     }
 
-    for (int i = 0; i < count; i++) printf("%d  %s\n", i+1, lines[i]);
+    for (int i = 0; i < count; i++) out_printf("%d  %s\n", i+1, lines[i]);
     return 0;
 }
 int cmd_help(int argc, char **argv) {
     (void)argc; (void)argv;
-    printf("\nCVX Shell Help - Built-in commands:\n");
-    printf("  cd [dir]                - Change directory (supports ~)\n");
-    printf("  pwd [-L|-P|--help]      - Print working directory (logical/physical)\n");
-    printf("  help                    - Show this help message\n");
-    printf("  ls                      - List directory contents (auto --color=auto)\n");
-    printf("  history                 - Show command history\n");
-    printf("  alias [<name>=<cmd>]    - Create a command alias\n");
-    printf("  unalias [name]          - Remove the specified alias\n");
-    printf("  echo [args]             - Display text (supports environment variables)\n");
-    printf("  export [VAR=value]      - Set environment variables\n");
-    printf("  jobs                    - List background jobs\n");
-    printf("  fg                      - Resume job in foreground\n");
-    printf("  bg                      - Resume job in background\n");
-    printf("  functions               - List all defined functions\n");
-    printf("  delfunc [name]          - Delete the specified function\n");
-    printf("  break [n]               - Exit from within a for, while, or until loop\n");
-    printf("  continue [n]            - Resume the next iteration of an enclosing loop\n");
-    printf("  :                       - Null command (returns 0 exit status)\n");
-    printf("  eval [arg ...]          - Combine arguments into a single command and execute it\n");
-    printf("  exec [command] [args]   - Replace the shell with the specified command\n");
-    printf("  exit                    - Exit the shell\n\n");
-    printf("External commands can be executed as usual via PATH.\n");
+    out_printf("\nCVX Shell Help - Built-in commands:\n");
+    out_printf("  cd [dir]                - Change directory (supports ~)\n");
+    out_printf("  pwd [-L|-P|--help]      - Print working directory (logical/physical)\n");
+    out_printf("  help                    - Show this help message\n");
+    out_printf("  ls                      - List directory contents (auto --color=auto)\n");
+    out_printf("  history                 - Show command history\n");
+    out_printf("  alias [<name>=<cmd>]    - Create a command alias\n");
+    out_printf("  unalias [name]          - Remove the specified alias\n");
+    out_printf("  echo [args]             - Display text (supports environment variables)\n");
+    out_printf("  printf format [args]    - Print arguments according to format\n");
+    out_printf("  export [VAR=value]      - Set environment variables\n");
+    out_printf("  jobs                    - List background jobs\n");
+    out_printf("  fg                      - Resume job in foreground\n");
+    out_printf("  bg                      - Resume job in background\n");
+    out_printf("  functions               - List all defined functions\n");
+    out_printf("  delfunc [name]          - Delete the specified function\n");
+    out_printf("  break [n]               - Exit from within a for, while, or until loop\n");
+    out_printf("  continue [n]            - Resume the next iteration of an enclosing loop\n");
+    out_printf("  :                       - Null command (returns 0 exit status)\n");
+    out_printf("  hash [-r] [-d] [name]   - Show, seed or reset remembered command paths\n");
+    out_printf("  type name ...           - Tell how each name would be run\n");
+    out_printf("  command [-v|-V] name    - Run or describe name, skipping functions\n");
+    out_printf("  eval [arg ...]          - Combine arguments into a single command and execute it\n");
+    out_printf("  shopt [-s|-u] [name]    - Set, unset or list shell options\n");
+    out_printf("  exec [command] [args]   - Replace the shell with the specified command\n");
+    out_printf("  pmap [-j N] cmd [args]  - Run cmd for each line of stdin, N at a time ({} is the line)\n");
+    out_printf("  exit                    - Exit the shell\n\n");
+    out_printf("External commands can be executed as usual via PATH.\n");
     return 0;
 }
 
 int cmd_ls(int argc, char **argv) {
-    char *args[128];
+    char **args = malloc((argc + 2) * sizeof(char *));
+    if (!args) { out_perror("ls"); return 1; }
     int new_argc = argc;
     bool has_color = false;
 
@@ -237,16 +389,19 @@ int cmd_ls(int argc, char **argv) {
         if (strcmp(argv[i], "--color=auto") == 0) has_color = true;
     }
 
-    if (!has_color && new_argc < 127) {
+    if (!has_color) {
         args[new_argc++] = "--color=auto";
     }
 
     args[new_argc] = NULL;
 
+    vars_environ();
+    out_flush();
     pid_t pid = fork();
-    if (pid < 0) { perror("fork"); return 1; }
+    if (pid < 0) { out_perror("fork"); free(args); return 1; }
     if (pid == 0) { execvp("ls", args); perror("execvp"); exit(EXIT_FAILURE); }
-    else { int status; waitpid(pid, &status, 0); return WIFEXITED(status) ? WEXITSTATUS(status) : 1; }
+    free(args);
+    int status; waitpid(pid, &status, 0); return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 }
 
 int cmd_exit(int argc, char **argv) {
@@ -257,7 +412,7 @@ int cmd_exit(int argc, char **argv) {
         if (*endptr == '\0') {
             status = (int)val;
         } else {
-            fprintf(stderr, "cvx: exit: %s: numeric argument required\n", argv[1]);
+            out_error("cvx: exit: %s: numeric argument required\n", argv[1]);
             status = 2; 
         }
     }
@@ -279,7 +434,7 @@ int cmd_fg(int argc, char **argv) {
 
     pid_t pgid = jobs_get_pgid(id);
     if (pgid <= 0) {
-        fprintf(stderr, "fg: no such job: %d\n", id);
+        out_error("fg: no such job: %d\n", id);
         return 1;
     }
 
@@ -306,7 +461,7 @@ int cmd_bg(int argc, char **argv) {
 
     pid_t pgid = jobs_get_pgid(id);
     if (pgid <= 0) {
-        fprintf(stderr, "bg: no such job: %d\n", id);
+        out_error("bg: no such job: %d\n", id);
         return 1;
     }
 
@@ -317,16 +472,16 @@ int cmd_bg(int argc, char **argv) {
 }
 
 static void alias_usage() {
-    printf("Usage: alias <name>-<command>\n");
-    printf("Example: alias ll-ls -l\n");
-    printf("Options:\n");
-    printf("  -h, --help, -help    Show this help message\n");
+    out_printf("Usage: alias <name>-<command>\n");
+    out_printf("Example: alias ll-ls -l\n");
+    out_printf("Options:\n");
+    out_printf("  -h, --help, -help    Show this help message\n");
 }
 
 int cmd_alias(int argc, char **argv) {
     if (argc < 2) {
         for (int i = 0; i < alias_count; i++) {
-            printf("alias %s='%s'\n", aliases[i].name, aliases[i].command);
+            out_printf("alias %s='%s'\n", aliases[i].name, aliases[i].command);
         }
         return 0;
     }
@@ -344,36 +499,36 @@ int cmd_alias(int argc, char **argv) {
 
     char *sep = strchr(full_arg, '-');
     if (!sep) {
-        printf("Error: Invalid alias format.\n");
+        out_printf("Error: Invalid alias format.\n");
         alias_usage();
         return 1;
     }
 
-    char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     if (!home) return 1;
     char path[1024];
     snprintf(path, sizeof(path), "%s/.cvx.conf", home);
 
     FILE *f = fopen(path, "a");
     if (!f) {
-        perror("fopen");
+        out_perror("fopen");
         return 1;
     }
 
     fprintf(f, "ALIAS=\"%s\"\n", full_arg);
     fclose(f);
 
-    printf("Alias added persistently to %s\n", path);
+    out_printf("Alias added persistently to %s\n", path);
     return 0;
 }
 
 int cmd_unalias(int argc, char **argv) {
     if (argc < 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help") || !strcmp(argv[1], "-help")) {
-        printf("Usage: unalias <name>\n");
+        out_printf("Usage: unalias <name>\n");
         return argc < 2 ? 1 : 0;
     }
 
-    char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     if (!home) return 1;
     char path[1024];
     snprintf(path, sizeof(path), "%s/.cvx.conf", home);
@@ -407,13 +562,13 @@ int cmd_unalias(int argc, char **argv) {
 
     if (found) {
         if (rename(temp_path, path) != 0) {
-            perror("rename");
+            out_perror("rename");
             return 1;
         }
-        printf("Alias '%s' removed from %s\n", argv[1], path);
+        out_printf("Alias '%s' removed from %s\n", argv[1], path);
     } else {
         remove(temp_path);
-        printf("unalias: %s: not found\n", argv[1]);
+        out_printf("unalias: %s: not found\n", argv[1]);
     }
 
     return 0;
@@ -468,11 +623,14 @@ int cmd_test(int argc, char **argv) {
 
 int cmd_bracket(int argc, char **argv) {
     if (argc < 2 || strcmp(argv[argc-1], "]") != 0) {
-        fprintf(stderr, "[: expected ']' as last argument\n");
+        out_error("[: expected ']' as last argument\n");
         return 1;
     }
+    char *bracket = argv[argc-1];
     argv[argc-1] = NULL;
-    return cmd_test(argc - 1, argv);
+    int status = cmd_test(argc - 1, argv);
+    argv[argc-1] = bracket;
+    return status;
 }
 
 int cmd_set(int argc, char **argv) {
@@ -491,8 +649,11 @@ int cmd_set(int argc, char **argv) {
 
 int cmd_exec(int argc, char **argv) {
     if (argc < 2) return 0;
+    char **envp = vars_environ();
+    const char *path = cmdhash_lookup(argv[1]);
+    if (path) execve(path, &argv[1], envp);
     execvp(argv[1], &argv[1]);
-    perror("exec");
+    out_perror("exec");
     return 1;
 }
 
@@ -511,3 +672,36 @@ int cmd_eval(int argc, char **argv) {
     free(cmd);
     return status;
 }
+
+int cmd_shopt(int argc, char **argv) {
+    int mode = 0;
+    int start = 1;
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) { mode = 1; start = 2; }
+    else if (argc > 1 && strcmp(argv[1], "-u") == 0) { mode = -1; start = 2; }
+
+    if (start >= argc) {
+        for (ShellOption *opt = shell_options; opt->name; opt++) {
+            if (mode == 0 || (mode == 1) == *opt->value)
+                out_printf("%-16s%s\n", opt->name, *opt->value ? "on" : "off");
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = start; i < argc; i++) {
+        ShellOption *opt = shell_options;
+        while (opt->name && strcmp(opt->name, argv[i]) != 0) opt++;
+        if (!opt->name) {
+            out_error("shopt: %s: invalid shell option name\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        if (mode == 0) {
+            out_printf("%-16s%s\n", opt->name, *opt->value ? "on" : "off");
+            if (!*opt->value) status = 1;
+        } else {
+            *opt->value = (mode == 1);
+        }
+    }
+    return status;
+}
@@ -11,6 +11,7 @@ int cmd_cd(int argc, char **argv);
 int cmd_ls(int argc, char **argv);
 int cmd_pwd(int argc, char **argv);
 int cmd_echo(int argc, char **argv);
+int cmd_printf(int argc, char **argv);
 int cmd_export(int argc, char **argv);
 int cmd_help(int argc, char **argv);
 int cmd_history(int argc, char **argv);
@@ -25,7 +26,9 @@ int cmd_set(int argc, char **argv);
 int cmd_exec(int argc, char **argv);
 int cmd_exit(int argc, char **argv);
 int cmd_eval(int argc, char **argv);
+int cmd_shopt(int argc, char **argv);
 int cmd_functions(int argc, char **argv);
 int cmd_delfunc(int argc, char **argv);
+int cmd_pmap(int argc, char **argv);
 
 #endif
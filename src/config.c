@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include "config.h"
+#include "vars.h"
 
 #include <sys/stat.h>
 #include <time.h>
@@ -23,6 +24,19 @@ int alias_count = 0;
 bool history_enabled = true;
 char start_dir[1024] = "";
 
+bool opt_treewalk = false;
+bool opt_forkexec = false;
+bool opt_globstar = false;
+bool opt_nosortglob = false;
+
+ShellOption shell_options[] = {
+    { "treewalk", &opt_treewalk },
+    { "forkexec", &opt_forkexec },
+    { "globstar", &opt_globstar },
+    { "nosortglob", &opt_nosortglob },
+    { NULL, NULL }
+};
+
 static time_t global_mtime = 0;
 static time_t local_mtime = 0;
 
@@ -125,7 +139,7 @@ void config() {
 
     parse_config_file("/etc/cvx.conf");
 
-    char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     if (home) {
         char user_config[1024];
         snprintf(user_config, sizeof(user_config), "%s/.cvx.conf", home);
@@ -150,7 +164,7 @@ void check_and_reload_config() {
         if (st.st_mtime > global_mtime) reload = true;
     }
 
-    char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     if (home) {
         char user_config[1024];
         snprintf(user_config, sizeof(user_config), "%s/.cvx.conf", home);
@@ -18,6 +18,13 @@ extern int alias_count;
 extern bool history_enabled;
 extern char start_dir[1024];
 
+typedef struct { const char *name; bool *value; } ShellOption;
+extern ShellOption shell_options[];
+extern bool opt_treewalk;
+extern bool opt_forkexec;
+extern bool opt_globstar;
+extern bool opt_nosortglob;
+
 void config(void);
 void check_and_reload_config(void);
 
@@ -3,6 +3,7 @@
 // All original author information and file headers must be preserved.
 // For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,11 @@
 #include <signal.h>
 #include <termios.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "parser.h"
 #include "ast.h"
 #include "commands.h"
@@ -20,6 +26,14 @@
 #include "utils.h"
 #include "linenoise.h"
 #include "functions.h"
+#include "vm.h"
+#include "vars.h"
+#include "cmdhash.h"
+#include "builtins.h"
+#include "brace.h"
+#include "fileglob.h"
+#include "out.h"
+#include "exec.h"
 
 static pid_t shell_pgid = -1;
 static pid_t fg_pgid = -1;
@@ -27,57 +41,321 @@ int last_exit_status = 0;
 int loop_control = 0;
 volatile sig_atomic_t sigint_received = 0;
 
-int exec_command(char *cmdline, bool background) {
-    if (!cmdline || !*cmdline)
-        return 0;
+static bool is_redirect_word(const char *w) {
+    if (isdigit((unsigned char)w[0]) && (w[1] == '<' || w[1] == '>')) return true;
+    return w[0] == '<' || w[0] == '>';
+}
 
-    if (shell_pgid == -1)
-        shell_pgid = getpgrp();
+// Replaces the child with an external command, going straight to the
+// hashed path. If that is gone (or is a script without #!), execvp()
+// gets a second try.
+static void exec_external(char **args) {
+    char **envp = vars_environ();
+    const char *path = cmdhash_lookup(args[0]);
+    if (!path) {
+        errno = ENOENT;
+        perror("exec");
+        exit(1);
+    }
+    execve(path, args, envp);
+    execvp(args[0], args);
+    perror("exec");
+    exit(1);
+}
+
+#define SPAWN_MAX_ACTIONS 16
+
+// What a spawned child does to its fds before exec, in order: dup2(from,
+// to), or close(to) when from is -1. opened holds the files the parent
+// opened for redirections; they are closed once the child exists.
+typedef struct {
+    struct { int from, to; } acts[SPAWN_MAX_ACTIONS];
+    int nacts;
+    int opened[SPAWN_MAX_ACTIONS];
+    int nopened;
+} SpawnPlan;
+
+static void plan_add(SpawnPlan *plan, int from, int to) {
+    plan->acts[plan->nacts].from = from;
+    plan->acts[plan->nacts].to = to;
+    plan->nacts++;
+}
 
-    char *args[256];
-    int argc = split_args(cmdline, args, 256);
+static void plan_release(SpawnPlan *plan) {
+    for (int i = 0; i < plan->nopened; i++) close(plan->opened[i]);
+    plan->nopened = 0;
+}
 
-    replace_alias(args, &argc);
+// Fork fallback for a plan that posix_spawn() could not carry out.
+static void plan_apply(SpawnPlan *plan) {
+    for (int i = 0; i < plan->nacts; i++) {
+        if (plan->acts[i].from < 0) close(plan->acts[i].to);
+        else if (dup2(plan->acts[i].from, plan->acts[i].to) < 0) perror("dup2");
+    }
+}
+
+// Does what handle_redirection() does in a child, but as a plan: files
+// are opened here with O_CLOEXEC and the words are removed from args.
+// Returns false, leaving args alone, for redirections that need a
+// forked child: here-documents, FIFOs (opening one would block the
+// shell) or more than the plan holds.
+static bool plan_redirections(char *args[], int *argc, SpawnPlan *plan) {
+    int count = 0;
+    for (int i = 0; i < *argc; i++) {
+        const char *op = args[i];
+        if (isdigit((unsigned char)op[0]) && (op[1] == '<' || op[1] == '>')) op++;
+        if (op[0] != '<' && op[0] != '>') continue;
+        if (strcmp(op, "<<") == 0) return false;
+        if (i + 1 < *argc && op[1] != '&') {
+            struct stat st;
+            if (stat(args[i + 1], &st) == 0 && S_ISFIFO(st.st_mode)) return false;
+        }
+        count++;
+    }
+    if (plan->nacts + count > SPAWN_MAX_ACTIONS) return false;
+
+    for (int i = 0; i < *argc; i++) {
+        char *op = args[i];
+        int src_fd = -1;
+        if (isdigit((unsigned char)op[0]) && (op[1] == '<' || op[1] == '>')) {
+            src_fd = op[0] - '0';
+            op++;
+        }
+        if (op[0] != '<' && op[0] != '>') continue;
+        if (strcmp(op, ">") != 0 && strcmp(op, ">>") != 0 && strcmp(op, "<") != 0 &&
+            strcmp(op, ">&") != 0 && strcmp(op, "<&") != 0) {
+            continue;
+        }
+        if (i + 1 >= *argc) {
+            fprintf(stderr, "cvx: syntax error near unexpected token 'newline'\n");
+            return true;
+        }
+
+        char *target = args[i + 1];
+        if (src_fd == -1) src_fd = (op[0] == '<') ? 0 : 1;
+
+        if (op[1] == '&') {
+            bool is_num = target[0] != '\0';
+            for (int k = 0; target[k]; k++) if (!isdigit((unsigned char)target[k])) is_num = false;
+            if (strcmp(target, "-") == 0) plan_add(plan, -1, src_fd);
+            else if (is_num) plan_add(plan, atoi(target), src_fd);
+            else fprintf(stderr, "cvx: %s: ambiguous redirect\n", target);
+        } else {
+            int flags = op[0] == '<' ? O_RDONLY
+                      : O_WRONLY | O_CREAT | (op[1] == '>' ? O_APPEND : O_TRUNC);
+            int fd = open(target, flags | O_CLOEXEC, 0644);
+            if (fd >= 0) {
+                plan->opened[plan->nopened++] = fd;
+                plan_add(plan, fd, src_fd);
+            } else {
+                perror(target);
+            }
+        }
 
-    for (int i = 0; i < argc; i++) {
-        char *expanded = expand_variables(args[i]);
         free(args[i]);
+        free(args[i + 1]);
+        for (int j = i; j + 2 <= *argc; j++) args[j] = args[j + 2];
+        *argc -= 2;
+        i--;
+    }
+    return true;
+}
+
+// Starts an external command without copying the shell's address space.
+// Process group and signal dispositions are set through spawn attributes
+// so nothing of the shell runs in the child. path is what the caller
+// got from cmdhash_lookup(). Returns -1 when it is NULL or the spawn
+// failed; the caller then forks instead, so errors are reported by the
+// child on its own (redirected) stderr.
+static pid_t spawn_external(const char *path, char **args, SpawnPlan *plan, pid_t pgid) {
+    if (!path) return -1;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    for (int i = 0; i < plan->nacts; i++) {
+        if (plan->acts[i].from < 0)
+            posix_spawn_file_actions_addclose(&actions, plan->acts[i].to);
+        else
+            posix_spawn_file_actions_adddup2(&actions, plan->acts[i].from, plan->acts[i].to);
+    }
+
+    sigset_t defaults, mask;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTSTP);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF |
+                                    POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &actions, &attr, args, vars_environ());
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err ? -1 : pid;
+}
+
+static int run_function(function_body_t *func, int argc, char **args) {
+    push_param_frame(argc, args);
+    sigint_received = 0;
+    loop_control = 0;
+    int status = opt_treewalk ? execute_ast(func->ast, false) : vm_run(func->prog);
+    pop_param_frame();
+    return status;
+}
+
+static bool is_assignment(const char *word) {
+    const char *eq = strchr(word, '=');
+    return eq && is_valid_name(word, eq - word);
+}
+
+// Brace expansion comes first, on the words as written. Assignments are
+// left alone.
+static void expand_braces(ArgVec *args) {
+    ArgVec out;
+    argv_init(&out);
+    for (int i = 0; i < args->n; i++) {
+        int count = 0;
+        char **words = NULL;
+        if (has_braces(args->v[i]) && !is_assignment(args->v[i])) words = brace_expand(args->v[i], &count);
+        if (!words) {
+            argv_push(&out, args->v[i]);
+            continue;
+        }
+        for (int k = 0; k < count; k++) argv_push(&out, words[k]);
+        free(words);
+        free(args->v[i]);
+    }
+    argv_release(args);
+    for (int i = 0; i < out.n; i++) argv_push(args, out.v[i]);
+    argv_release(&out);
+}
+
+// Runs every expansion on the words in args but pathname expansion and
+// quote removal, splitting fields in place.
+void expand_words(ArgVec *args) {
+    expand_braces(args);
+    bool split = false;
+    for (int i = 0; i < args->n; i++) {
+        char *expanded = expand_variables(args->v[i]);
+        free(args->v[i]);
         char *t_expanded = expand_tilde(expanded);
         free(expanded);
-        args[i] = t_expanded;
+        args->v[i] = t_expanded;
+        if (strchr(t_expanded, '\x11')) split = true;
     }
 
-    char *new_args[256];
-    int new_argc = 0;
-    for (int i = 0; i < argc; i++) {
-        if (strchr(args[i], '\x11')) {
-            char *p = args[i];
+    if (split) {
+        ArgVec out;
+        argv_init(&out);
+        for (int i = 0; i < args->n; i++) {
+            if (!strchr(args->v[i], '\x11')) {
+                argv_push(&out, args->v[i]);
+                continue;
+            }
+            char *p = args->v[i];
             char *start = p;
             while (*p) {
                 if (*p == '\x11') {
                     *p = '\0';
-                    if (start != p) {
-                        new_args[new_argc++] = strdup(start);
-                    }
+                    if (start != p) argv_push(&out, strdup(start));
                     start = p + 1;
                 }
                 p++;
             }
-            if (*start) {
-                new_args[new_argc++] = strdup(start);
-            }
-            free(args[i]);
-        } else {
-            new_args[new_argc++] = args[i];
+            if (*start) argv_push(&out, strdup(start));
+            free(args->v[i]);
+        }
+        argv_release(args);
+        for (int i = 0; i < out.n; i++) argv_push(args, out.v[i]);
+        argv_release(&out);
+    }
+}
+
+static void expand_args(ArgVec *args, GlobCache **cache) {
+    expand_words(args);
+    expand_glob(args, cache);
+    quote_removal(args->v, args->n);
+}
+
+static void build_line_args(const char *cmdline, ArgVec *args) {
+    GlobCache *cache = NULL;
+    split_args(cmdline, args);
+    replace_alias(args);
+    expand_args(args, &cache);
+    glob_cache_free(cache);
+}
+
+static bool is_alias(const char *name) {
+    for (int i = 0; i < alias_count; i++) {
+        if (strcmp(name, aliases[i].name) == 0) return true;
+    }
+    return false;
+}
+
+static void build_command_args(ASTNode *node, ArgVec *args) {
+    if (node->command.nwords == 0 || is_alias(node->command.words[0].text)) {
+        build_line_args(node->command.text, args);
+        return;
+    }
+
+    ArgVec fields;
+    argv_init(&fields);
+    GlobCache *cache = NULL;
+    for (int i = 0; i < node->command.nwords; i++) {
+        Word *w = &node->command.words[i];
+        if (w->flags == WORD_LITERAL) {
+            argv_push(args, strdup(w->text));
+            continue;
         }
+        argv_push(&fields, strdup(w->text));
+        expand_args(&fields, &cache);
+        for (int k = 0; k < fields.n; k++) argv_push(args, fields.v[k]);
+        argv_release(&fields);
     }
-    argc = new_argc;
-    for (int i = 0; i < argc; i++) args[i] = new_args[i];
-    args[argc] = NULL;
+    glob_cache_free(cache);
+}
+
+static int run_args(char *args[], int argc, const char *cmdline, bool background);
+
+int exec_command(char *cmdline, bool background) {
+    if (!cmdline || !*cmdline)
+        return 0;
+
+    if (shell_pgid == -1)
+        shell_pgid = getpgrp();
 
-    expand_glob(args, &argc, 256);
-    quote_removal(args, argc);
+    ArgVec args;
+    argv_init(&args);
+    build_line_args(cmdline, &args);
+    int status = run_args(args.v, args.n, cmdline, background);
+    argv_release(&args);
+    return status;
+}
 
+int exec_node(ASTNode *node, bool background) {
+    if (!node->command.text || !*node->command.text)
+        return 0;
+
+    if (shell_pgid == -1)
+        shell_pgid = getpgrp();
+
+    ArgVec args;
+    argv_init(&args);
+    build_command_args(node, &args);
+    int status = run_args(args.v, args.n, node->command.text, background);
+    argv_release(&args);
+    return status;
+}
+
+static int run_command(char *args[], int argc, const char *cmdline, bool background, bool has_redirect);
+
+static int run_args(char *args[], int argc, const char *cmdline, bool background) {
     if (argc == 0) return 0;
 
     bool has_redirect = false;
@@ -91,29 +369,76 @@ int exec_command(char *cmdline, bool background) {
         }
     }
     
-    while (argc > 0 && strchr(args[0], '=') != NULL && !has_redirect) {
-        quote_removal(args, 1);
-        char *eq = strchr(args[0], '=');
-        if (eq > args[0]) {
+    int nassign = 0;
+    while (!has_redirect && nassign < argc && is_assignment(args[nassign])) nassign++;
+    if (nassign == 0) return run_command(args, argc, cmdline, background, has_redirect);
+
+    quote_removal(args, nassign);
+    if (nassign == argc) {
+        for (int i = 0; i < argc; i++) {
+            char *eq = strchr(args[i], '=');
             *eq = '\0';
-            char *varname = args[0];
-            char *value = eq + 1;
-            setenv(varname, value, 1);
-            
-            free(args[0]);
-            for (int j = 0; j < argc; j++) args[j] = args[j+1];
-            argc--;
-        } else break;
+            vars_set(args[i], eq + 1);
+        }
+        free_args(args, argc);
+        return 0;
     }
-    if (argc == 0) return 0;
 
-    const char *func_body = get_function(args[0]);
-    if (func_body) {
-        push_param_frame(argc, args);
-        char *body_copy = strdup(func_body);
-        last_exit_status = process_command_line(body_copy);
-        free(body_copy);
-        pop_param_frame();
+    // VAR=value before a command is exported to that command only.
+    for (int i = 0; i < nassign; i++) {
+        char *eq = strchr(args[i], '=');
+        *eq = '\0';
+        vars_push_temp(args[i], eq + 1);
+        free(args[i]);
+    }
+    memmove(args, args + nassign, (argc - nassign + 1) * sizeof(char *));
+    int status = run_command(args, argc - nassign, cmdline, background, false);
+    vars_pop_temps(nassign);
+    return status;
+}
+
+// Applies the redirections of a builtin or function call to the shell
+// itself for the length of the call. Every fd a redirection touches is
+// saved first and put back afterwards, closed again if it was closed.
+static int run_redirected(function_body_t *func, const Builtin *b, char *args[], int *argc) {
+    int saved[10];
+    bool touched[10] = { false };
+    for (int i = 0; i < *argc; i++) {
+        const char *op = args[i];
+        int fd = -1;
+        if (isdigit((unsigned char)op[0]) && (op[1] == '<' || op[1] == '>')) fd = op[0] - '0';
+        else if (op[0] == '<') fd = 0;
+        else if (op[0] == '>') fd = 1;
+        if (fd < 0 || touched[fd]) continue;
+        touched[fd] = true;
+        saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    }
+
+    fflush(stdout);
+    handle_redirection(args, argc);
+    int status = 0;
+    if (*argc > 0) status = func ? run_function(func, *argc, args) : builtin_run(b, *argc, args);
+    out_flush();
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int fd = 0; fd < 10; fd++) {
+        if (!touched[fd]) continue;
+        if (saved[fd] >= 0) {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        } else {
+            close(fd);
+        }
+    }
+    return status;
+}
+
+static int run_command(char *args[], int argc, const char *cmdline, bool background, bool has_redirect) {
+    function_body_t *func = acquire_function(args[0]);
+    if (func) {
+        last_exit_status = has_redirect ? run_redirected(func, NULL, args, &argc) : run_function(func, argc, args);
+        release_function(func);
         free_args(args, argc);
         return last_exit_status;
     }
@@ -126,43 +451,43 @@ int exec_command(char *cmdline, bool background) {
         return last_exit_status;
     }
 
-    if (!has_redirect) {
-        int builtin_status = -1;
-        if (!strcmp(args[0], "cd")) builtin_status = cmd_cd(argc, args);
-        else if (!strcmp(args[0], "pwd")) builtin_status = cmd_pwd(argc, args);
-        else if (!strcmp(args[0], "export")) builtin_status = cmd_export(argc, args);
-        else if (!strcmp(args[0], "help")) builtin_status = cmd_help(argc, args);
-        else if (!strcmp(args[0], "ls")) builtin_status = cmd_ls(argc, args);
-        else if (!strcmp(args[0], "history")) builtin_status = cmd_history(argc, args);
-        else if (!strcmp(args[0], "echo")) builtin_status = cmd_echo(argc, args);
-        else if (!strcmp(args[0], "jobs")) builtin_status = cmd_jobs(argc, args);
-        else if (!strcmp(args[0], "fg")) builtin_status = cmd_fg(argc, args);
-        else if (!strcmp(args[0], "bg")) builtin_status = cmd_bg(argc, args);
-        else if (!strcmp(args[0], "alias")) builtin_status = cmd_alias(argc, args);
-        else if (!strcmp(args[0], "unalias")) builtin_status = cmd_unalias(argc, args);
-        else if (!strcmp(args[0], "test")) builtin_status = cmd_test(argc, args);
-        else if (!strcmp(args[0], "[")) builtin_status = cmd_bracket(argc, args);
-        else if (!strcmp(args[0], "functions")) builtin_status = cmd_functions(argc, args);
-        else if (!strcmp(args[0], "delfunc")) builtin_status = cmd_delfunc(argc, args);
-        else if (!strcmp(args[0], "set")) builtin_status = cmd_set(argc, args);
-        else if (!strcmp(args[0], "break")) { loop_control = 1; builtin_status = 0; }
-        else if (!strcmp(args[0], "continue")) { loop_control = 2; builtin_status = 0; }
-        else if (!strcmp(args[0], ":")) builtin_status = 0;
-        else if (!strcmp(args[0], "exit")) builtin_status = cmd_exit(argc, args);
-        else if (!strcmp(args[0], "eval")) builtin_status = cmd_eval(argc, args);
-
-        if (builtin_status != -1) {
-            last_exit_status = builtin_status;
-            free_args(args, argc);
-            return last_exit_status;
-        }
+    const Builtin *b = builtin_lookup(args[0]);
+    if (b && (!has_redirect || (b->flags & BUILTIN_REDIRECT))) {
+        last_exit_status = has_redirect ? run_redirected(NULL, b, args, &argc) : builtin_run(b, argc, args);
+        free_args(args, argc);
+        return last_exit_status;
     }
 
-    pid_t pid = fork();
+    return exec_external_args(args, argc, cmdline, background);
+}
+
+// Runs args as an external command and waits for it, or records it as a
+// job when background is set. Takes ownership of the strings in args.
+int exec_external_args(char *args[], int argc, const char *cmdline, bool background) {
+    // Resolve in the parent so the hash outlives the child.
+    bool resolved = !is_redirect_word(args[0]);
+    const char *path = resolved ? cmdhash_lookup(args[0]) : NULL;
+    out_flush();
+    vars_environ();
+
+    SpawnPlan plan = { .nacts = 0, .nopened = 0 };
+    bool spawnable = !opt_forkexec && plan_redirections(args, &argc, &plan);
+    if (spawnable && argc == 0) {
+        plan_release(&plan);
+        last_exit_status = 0;
+        return 0;
+    }
+
+    if (spawnable && !resolved) path = cmdhash_lookup(args[0]);
+    pid_t pid = spawnable ? spawn_external(path, args, &plan, 0) : -1;
     if (pid < 0) {
-        perror("fork");
-        free_args(args, argc);
-        return 1;
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            plan_release(&plan);
+            free_args(args, argc);
+            return 1;
+        }
     }
 
     if (pid == 0) {
@@ -170,11 +495,12 @@ int exec_command(char *cmdline, bool background) {
         signal(SIGINT, SIG_DFL);
         signal(SIGTSTP, SIG_DFL);
 
-        handle_redirection(args, &argc);
-        execvp(args[0], args);
-        perror("exec");
-        exit(1);
+        if (spawnable) plan_apply(&plan);
+        else handle_redirection(args, &argc);
+        if (argc == 0) exit(0);
+        exec_external(args);
     }
+    plan_release(&plan);
 
     setpgid(pid, pid);
 
@@ -205,7 +531,280 @@ int exec_command(char *cmdline, bool background) {
     return last_exit_status;
 }
 
-int execute_pipeline(char **cmds, int n, bool background) {
+// Starts args, taken as they are with no expansion or redirections, as a
+// task of pool writing to out_fd and err_fd. An external command goes
+// through posix_spawn() like any other; functions and builtins, and
+// commands that could not be spawned, run in a forked child.
+pid_t spawn_task(char **args, int argc, const JobPool *pool, int out_fd, int err_fd) {
+    vars_environ();
+    pid_t pid = -1;
+    if (!opt_forkexec && !has_function(args[0]) && !builtin_lookup(args[0])) {
+        SpawnPlan plan = { .nacts = 0, .nopened = 0 };
+        int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (null_fd >= 0) {
+            plan.opened[plan.nopened++] = null_fd;
+            plan_add(&plan, null_fd, STDIN_FILENO);
+        }
+        if (out_fd >= 0) plan_add(&plan, out_fd, STDOUT_FILENO);
+        if (err_fd >= 0) plan_add(&plan, err_fd, STDERR_FILENO);
+        pid = spawn_external(cmdhash_lookup(args[0]), args, &plan, getpgrp());
+        plan_release(&plan);
+        if (pid > 0) return pid;
+    }
+
+    pid = fork();
+    if (pid != 0) {
+        if (pid < 0) perror("fork");
+        return pid;
+    }
+    pool_child(pool, out_fd, err_fd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    function_body_t *func = acquire_function(args[0]);
+    if (func) exit(run_function(func, argc, args));
+    const Builtin *b = builtin_lookup(args[0]);
+    if (b) exit(builtin_run(b, argc, args));
+    exec_external(args);
+    return -1;
+}
+
+// A stage can be spawned when it is an external command whose words can
+// all be expanded in the parent without running shell code or changing
+// its variables, as $((i+=1)) would.
+static bool stage_is_external(ASTNode *st) {
+    if (st->type != AST_COMMAND || st->command.nwords == 0) return false;
+    const Word *first = &st->command.words[0];
+    if (first->flags != WORD_LITERAL || is_redirect_word(first->text) || strchr(first->text, '=') ||
+        builtin_lookup(first->text) || has_function(first->text) || is_alias(first->text)) {
+        return false;
+    }
+    for (int i = 0; i < st->command.nwords; i++) {
+        const Word *w = &st->command.words[i];
+        if ((w->flags & (WORD_CMDSUB | WORD_ARITH)) || strstr(w->text, "${")) return false;
+    }
+    return true;
+}
+
+// Spawns one pipeline stage, whose command resolved to path, reading
+// in_fd and writing out_fd (-1 for the shell's stdout). Returns -1 if the
+// stage has to be forked instead.
+static pid_t spawn_stage(ASTNode *st, const char *path, int in_fd, int out_fd, pid_t pgid) {
+    ArgVec args;
+    argv_init(&args);
+    build_command_args(st, &args);
+    int argc = args.n;
+
+    SpawnPlan plan = { .nacts = 0, .nopened = 0 };
+    if (in_fd != 0) plan_add(&plan, in_fd, STDIN_FILENO);
+    if (out_fd >= 0) plan_add(&plan, out_fd, STDOUT_FILENO);
+
+    pid_t pid = -1;
+    if (argc > 0 && plan_redirections(args.v, &argc, &plan) && argc > 0)
+        pid = spawn_external(path, args.v, &plan, pgid);
+    plan_release(&plan);
+    free_args(args.v, argc);
+    argv_release(&args);
+    return pid;
+}
+
+#define INPROC_CALL_DEPTH 8
+
+// The name a command word runs when it needs no expansion. A lone [ is
+// kept as a glob word by the parser but can only ever mean itself.
+static const char *literal_name(const Word *w) {
+    if (w->flags == WORD_LITERAL) return w->text;
+    if (w->flags == WORD_GLOB && strcmp(w->text, "\x03") == 0) return "[";
+    return NULL;
+}
+
+static bool tree_runs_inproc(ASTNode *node, int depth);
+
+// A command can run inside the shell when it only assigns variables or
+// calls a builtin that is parent-safe or whose effects can be undone, or
+// a function passing the same test, nested at most INPROC_CALL_DEPTH deep.
+static bool command_runs_inproc(ASTNode *node, int depth) {
+    int k = 0;
+    while (k < node->command.nwords && is_assignment(node->command.words[k].text)) k++;
+    if (k == node->command.nwords) return true;
+    const char *name = literal_name(&node->command.words[k]);
+    if (!name || is_alias(name)) return false;
+
+    function_body_t *func = acquire_function(name);
+    if (func) {
+        bool safe = depth < INPROC_CALL_DEPTH && tree_runs_inproc(func->ast, depth + 1);
+        release_function(func);
+        return safe;
+    }
+    const Builtin *b = builtin_lookup(name);
+    return b && (b->flags & (BUILTIN_PARENT_OK | BUILTIN_UNDOABLE));
+}
+
+// A tree can run inside the shell, as if in a subshell, when it is
+// control flow over such commands. Pipelines, subshells, background jobs
+// and function definitions all rule it out, as does any external command:
+// those would fork anyway, take the terminal or change shell state.
+static bool tree_runs_inproc(ASTNode *node, int depth) {
+    while (node) {
+        switch (node->type) {
+            case AST_COMMAND:
+                return command_runs_inproc(node, depth);
+            case AST_AND:
+            case AST_OR:
+            case AST_SEQUENCE:
+                if (!tree_runs_inproc(node->binary.left, depth)) return false;
+                node = node->binary.right;
+                break;
+            case AST_NEGATION:
+                node = node->unary.body;
+                break;
+            case AST_IF:
+                if (!tree_runs_inproc(node->if_stmt.cond, depth) ||
+                    !tree_runs_inproc(node->if_stmt.then_branch, depth))
+                    return false;
+                node = node->if_stmt.else_branch;
+                break;
+            case AST_CASE:
+                for (int i = 0; i < node->case_stmt.narms; i++)
+                    if (!tree_runs_inproc(node->case_stmt.arms[i].body, depth)) return false;
+                return true;
+            case AST_FOR:
+                node = node->for_loop.body;
+                break;
+            case AST_ARITH:
+                return true;
+            case AST_ARITH_FOR:
+                node = node->arith_for.body;
+                break;
+            case AST_WHILE:
+            case AST_UNTIL:
+                if (!tree_runs_inproc(node->loop.cond, depth)) return false;
+                node = node->loop.body;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool stage_runs_inproc(ASTNode *st) {
+    if (st->type != AST_COMMAND || st->command.nwords == 0) return false;
+    for (int i = 0; i < st->command.nwords; i++)
+        if (is_redirect_word(st->command.words[i].text)) return false;
+    return command_runs_inproc(st, 0);
+}
+
+static volatile sig_atomic_t stage_pipe_broken = 0;
+
+static void stage_sigpipe(int signo) {
+    (void)signo;
+    stage_pipe_broken = 1;
+    sigint_received = 1;
+}
+
+// Runs a pipeline stage in the shell with its pipe ends on stdin and
+// stdout. Variable changes are rolled back afterwards, as if the stage
+// had run in a child, and a write to a closed pipe stops it the way
+// SIGPIPE would have stopped the child.
+static int run_stage_inproc(ASTNode *st, int in_fd, int out_fd) {
+    int saved_in = -1, saved_out = -1;
+    if (in_fd > 0) {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(in_fd, STDIN_FILENO);
+        close(in_fd);
+    }
+    if (out_fd >= 0) {
+        out_flush();
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(out_fd, STDOUT_FILENO);
+        close(out_fd);
+    }
+
+    struct sigaction sa, old_pipe;
+    sa.sa_handler = stage_sigpipe;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGPIPE, &sa, &old_pipe);
+    sig_atomic_t old_sigint = sigint_received;
+    int old_loop = loop_control;
+    stage_pipe_broken = 0;
+
+    size_t mark = vars_undo_begin();
+    int status = exec_node(st, false);
+    vars_undo_end(mark);
+    loop_control = old_loop;
+
+    out_flush();
+    clearerr(stdout);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    if (stage_pipe_broken) {
+        status = 128 + SIGPIPE;
+        sigint_received = old_sigint;
+    }
+
+    if (in_fd > 0) {
+        if (saved_in >= 0) {
+            dup2(saved_in, STDIN_FILENO);
+            close(saved_in);
+        } else {
+            close(STDIN_FILENO);
+        }
+    }
+    if (out_fd >= 0) {
+        if (saved_out >= 0) {
+            dup2(saved_out, STDOUT_FILENO);
+            close(saved_out);
+        } else {
+            close(STDOUT_FILENO);
+        }
+    }
+    return status;
+}
+
+// Runs the text of a $(...) in the shell when its whole tree can run
+// in-process, with stdout going to a memfd. Variables, loop control and
+// $? are put back afterwards, as a subshell would have left them.
+// Returns the memfd rewound to the start of the output, or -1 when the
+// substitution needs a subshell.
+int capture_inproc(const char *cmd) {
+    Arena arena;
+    arena_init(&arena);
+    bool error = false;
+    ASTNode *ast = parse_ast_silent(cmd, &arena, &error);
+    int fd = -1;
+    if (!ast || error || !tree_runs_inproc(ast, 0) ||
+        (fd = memfd_create("cvx-subst", MFD_CLOEXEC)) < 0) {
+        arena_release(&arena);
+        return -1;
+    }
+
+    out_flush();
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(fd, STDOUT_FILENO);
+
+    int old_status = last_exit_status, old_loop = loop_control;
+    sig_atomic_t old_sigint = sigint_received;
+    size_t mark = vars_undo_begin();
+    execute_parsed(ast);
+    vars_undo_end(mark);
+    out_flush();
+    last_exit_status = old_status;
+    loop_control = old_loop;
+    if (old_sigint) sigint_received = 1;
+    arena_release(&arena);
+
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    } else {
+        close(STDOUT_FILENO);
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+int execute_pipeline(ASTNode **stages, int n, bool background) {
     int in_fd = 0;
     int pipefd[2];
     pid_t pgid = -1;
@@ -213,15 +812,56 @@ int execute_pipeline(char **cmds, int n, bool background) {
     if (shell_pgid == -1)
         shell_pgid = getpgrp();
 
+    // On a terminal the children's group takes the foreground, so ^C and
+    // ^Z would never reach a stage run by the shell; fork them all there.
+    bool external[n];
+    const char *paths[n];
+    int inproc = -1;
+    bool may_inproc = !background && !isatty(STDIN_FILENO);
+    for (int i = 0; i < n; i++) {
+        external[i] = stage_is_external(stages[i]);
+        paths[i] = external[i] ? cmdhash_lookup(stages[i]->command.words[0].text) : NULL;
+        if (!external[i] && inproc == -1 && may_inproc && stage_runs_inproc(stages[i])) inproc = i;
+    }
+    out_flush();
+    vars_environ();
+
+    // The in-process stage runs after every other stage has started, so
+    // SIGCHLD stays blocked until the wait below has collected them.
+    sigset_t chld_mask, old_mask;
+    int inproc_in = -1, inproc_out = -1;
+    if (inproc >= 0) {
+        sigemptyset(&chld_mask);
+        sigaddset(&chld_mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld_mask, &old_mask);
+    }
+    pid_t status_pid = -1;
+
     for (int i = 0; i < n; i++) {
-        if (i != n - 1 && pipe(pipefd) < 0) {
+        if (i != n - 1 && pipe2(pipefd, O_CLOEXEC) < 0) {
             perror("pipe");
+            if (inproc >= 0) sigprocmask(SIG_SETMASK, &old_mask, NULL);
             return 1;
         }
 
-        pid_t pid = fork();
+        if (i == inproc) {
+            inproc_in = in_fd;
+            if (i != n - 1) {
+                inproc_out = pipefd[1];
+                in_fd = pipefd[0];
+            }
+            continue;
+        }
+
+        pid_t pid = -1;
+        if (external[i] && !opt_forkexec) {
+            pid = spawn_stage(stages[i], paths[i], in_fd, i != n - 1 ? pipefd[1] : -1,
+                              pgid == -1 ? 0 : pgid);
+        }
+        if (pid < 0) pid = fork();
         if (pid < 0) {
             perror("fork");
+            if (inproc >= 0) sigprocmask(SIG_SETMASK, &old_mask, NULL);
             return 1;
         }
 
@@ -234,6 +874,12 @@ int execute_pipeline(char **cmds, int n, bool background) {
             signal(SIGINT, SIG_DFL);
             signal(SIGTSTP, SIG_DFL);
 
+            if (inproc >= 0) {
+                sigprocmask(SIG_SETMASK, &old_mask, NULL);
+                if (inproc_in > 0) close(inproc_in);
+                if (inproc_out >= 0) close(inproc_out);
+            }
+
             if (in_fd != 0) {
                 dup2(in_fd, STDIN_FILENO);
                 close(in_fd);
@@ -245,97 +891,33 @@ int execute_pipeline(char **cmds, int n, bool background) {
                 close(pipefd[1]);
             }
 
-            char *args[256];
-            int argc = split_args(cmds[i], args, 256);
-
-            replace_alias(args, &argc);
-
-            for (int j = 0; j < argc; j++) {
-                char *expanded = expand_variables(args[j]);
-                free(args[j]);
-                char *t_expanded = expand_tilde(expanded);
-                free(expanded);
-                args[j] = t_expanded;
-            }
-
-            char *new_args[256];
-            int new_argc = 0;
-            for (int k = 0; k < argc; k++) {
-                if (strchr(args[k], '\x11')) {
-                    char *p = args[k];
-                    char *start = p;
-                    while (*p) {
-                        if (*p == '\x11') {
-                            *p = '\0';
-                            if (start != p) {
-                                new_args[new_argc++] = strdup(start);
-                            }
-                            start = p + 1;
-                        }
-                        p++;
-                    }
-                    if (*start) {
-                        new_args[new_argc++] = strdup(start);
-                    }
-                    free(args[k]);
-                } else {
-                    new_args[new_argc++] = args[k];
-                }
-            }
-            argc = new_argc;
-            for (int k = 0; k < argc; k++) args[k] = new_args[k];
-            args[argc] = NULL;
-
-            expand_glob(args, &argc, 256);
-            quote_removal(args, argc);
+            ArgVec argv;
+            argv_init(&argv);
+            build_command_args(stages[i], &argv);
+            char **args = argv.v;
+            int argc = argv.n;
 
             handle_redirection(args, &argc);
 
             if (argc == 0) exit(0);
 
-            const char *func_body = get_function(args[0]);
-            if (func_body) {
-                push_param_frame(argc, args);
-                char *body_copy = strdup(func_body);
-                int status = process_command_line(body_copy);
-                free(body_copy);
-                pop_param_frame();
-                exit(status);
+            function_body_t *func = acquire_function(args[0]);
+            if (func) {
+                exit(run_function(func, argc, args));
             }
 
-            int builtin_status = -1;
-            if (!strcmp(args[0], "cd")) builtin_status = cmd_cd(argc, args);
-            else if (!strcmp(args[0], "pwd")) builtin_status = cmd_pwd(argc, args);
-            else if (!strcmp(args[0], "export")) builtin_status = cmd_export(argc, args);
-            else if (!strcmp(args[0], "help")) builtin_status = cmd_help(argc, args);
-            else if (!strcmp(args[0], "ls")) builtin_status = cmd_ls(argc, args);
-            else if (!strcmp(args[0], "history")) builtin_status = cmd_history(argc, args);
-            else if (!strcmp(args[0], "echo")) builtin_status = cmd_echo(argc, args);
-            else if (!strcmp(args[0], "jobs")) builtin_status = cmd_jobs(argc, args);
-            else if (!strcmp(args[0], "fg")) builtin_status = cmd_fg(argc, args);
-            else if (!strcmp(args[0], "bg")) builtin_status = cmd_bg(argc, args);
-            else if (!strcmp(args[0], "alias")) builtin_status = cmd_alias(argc, args);
-            else if (!strcmp(args[0], "unalias")) builtin_status = cmd_unalias(argc, args);
-            else if (!strcmp(args[0], "test")) builtin_status = cmd_test(argc, args);
-            else if (!strcmp(args[0], "[")) builtin_status = cmd_bracket(argc, args);
-            else if (!strcmp(args[0], "functions")) builtin_status = cmd_functions(argc, args);
-            else if (!strcmp(args[0], "delfunc")) builtin_status = cmd_delfunc(argc, args);
-            else if (!strcmp(args[0], "set")) builtin_status = cmd_set(argc, args);
-            else if (!strcmp(args[0], "break")) { loop_control = 1; builtin_status = 0; }
-            else if (!strcmp(args[0], "continue")) { loop_control = 2; builtin_status = 0; }
-            else if (!strcmp(args[0], ":")) builtin_status = 0;
-            else if (!strcmp(args[0], "exit")) exit(0);
-            else if (!strcmp(args[0], "exec")) builtin_status = cmd_exec(argc, args);
-
-            if (builtin_status != -1) exit(builtin_status);
-
-            execvp(args[0], args);
-            perror("exec");
-            exit(1);
+            const Builtin *b = builtin_lookup(args[0]);
+            if (b) {
+                exit(builtin_run(b, argc, args));
+            }
+
+            exec_external(args);
         }
 
         if (pgid == -1)
             pgid = pid;
+        if (i == 0)
+            status_pid = pid;
 
         setpgid(pid, pgid);
 
@@ -349,22 +931,26 @@ int execute_pipeline(char **cmds, int n, bool background) {
     }
 
     if (background) {
-        jobs_add(pgid, cmds[0], JOB_RUNNING);
+        jobs_add(pgid, stages[0]->command.text, JOB_RUNNING);
         printf("[%d] %d\n", jobs_last_id(), pgid);
     } else {
         fg_pgid = pgid;
         tcsetpgrp(STDIN_FILENO, fg_pgid);
+        if (inproc >= 0) {
+            int inproc_status = run_stage_inproc(stages[inproc], inproc_in, inproc_out);
+            if (inproc == 0) last_exit_status = inproc_status;
+        }
         int status;
         pid_t wpid;
         while ((wpid = waitpid(-fg_pgid, &status, WUNTRACED)) > 0) {
-            if (wpid == pgid) {
+            if (wpid == status_pid) {
                 last_exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : (WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 0);
             }
             if (WIFSTOPPED(status) || WIFSIGNALED(status)) {
                 write(STDOUT_FILENO, "\n", 1);
             }
             if (WIFSTOPPED(status)) {
-                jobs_add(fg_pgid, cmds[0], JOB_STOPPED);
+                jobs_add(fg_pgid, stages[0]->command.text, JOB_STOPPED);
                 break;
             }
         }
@@ -372,5 +958,6 @@ int execute_pipeline(char **cmds, int n, bool background) {
         fg_pgid = -1;
     }    
 
+    if (inproc >= 0) sigprocmask(SIG_SETMASK, &old_mask, NULL);
     return last_exit_status;
 }
@@ -11,6 +11,7 @@
 #include "config.h"
 #include "signals.h"
 #include "linenoise.h"
+#include "jobs.h"
 
 #include <signal.h>
 
@@ -19,6 +20,11 @@ extern int loop_control;
 extern volatile sig_atomic_t sigint_received;
 
 int exec_command(char *cmdline, bool background);
-int execute_pipeline(char **cmds, int n, bool background);
+int exec_node(ASTNode *node, bool background);
+int execute_pipeline(ASTNode **stages, int n, bool background);
+int exec_external_args(char *args[], int argc, const char *cmdline, bool background);
+int capture_inproc(const char *cmd);
+pid_t spawn_task(char **args, int argc, const JobPool *pool, int out_fd, int err_fd);
+void expand_words(ArgVec *args);
 
 #endif
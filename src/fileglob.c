@@ -0,0 +1,803 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <locale.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "fileglob.h"
+#include "config.h"
+#include "vars.h"
+
+#define GLOB_CACHE_BUCKETS 64
+#define DENTS_BUF 65536
+
+// A ** walk stays on the calling thread until this many directories are
+// waiting, so small trees never pay for starting threads.
+#define GLOB_PARALLEL_DIRS 32
+#define GLOB_MAX_THREADS 8
+
+enum { G_CHAR, G_ANY, G_STAR, G_CLASS };
+
+typedef struct {
+    unsigned char op;
+    unsigned char c;
+    int cls;
+} GInsn;
+
+// One path component of a pattern.
+struct GlobPat {
+    GInsn *ins;
+    int n;
+    unsigned char (*classes)[32];
+    bool literal;
+    bool dot;
+    bool globstar;
+    char *text;
+    char *suffix;
+    size_t suffix_len;
+};
+
+typedef struct {
+    char *names;
+    unsigned *offs;
+    unsigned char *types;
+    int n;
+} Listing;
+
+typedef struct CacheEntry {
+    char *dir;
+    Listing list;
+    bool ok;
+    struct CacheEntry *next;
+} CacheEntry;
+
+struct GlobCache {
+    CacheEntry *buckets[GLOB_CACHE_BUCKETS];
+};
+
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef void (*DirFn)(void *arg, int dfd, const char *name, unsigned char type);
+
+// Calls fn for every entry of dir, "." included. Returns false when the
+// directory cannot be opened.
+static bool read_dir(const char *dir, DirFn fn, void *arg) {
+    int fd = open(*dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char *buf = malloc(DENTS_BUF);
+    if (!buf) {
+        close(fd);
+        return false;
+    }
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, DENTS_BUF)) > 0) {
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            fn(arg, fd, d->d_name, d->d_type);
+            off += d->d_reclen;
+        }
+    }
+    free(buf);
+    close(fd);
+    return true;
+}
+
+static bool is_dir_at(int dfd, const char *name, unsigned char type, bool follow) {
+    if (type == DT_DIR) return true;
+    if (type != DT_UNKNOWN && (type != DT_LNK || !follow)) return false;
+    struct stat st;
+    return fstatat(dfd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+static char *join(const char *base, const char *name, bool slash) {
+    size_t bl = strlen(base), nl = strlen(name);
+    char *s = malloc(bl + nl + 2);
+    if (!s) return NULL;
+    memcpy(s, base, bl);
+    memcpy(s + bl, name, nl);
+    if (slash) s[bl + nl++] = '/';
+    s[bl + nl] = '\0';
+    return s;
+}
+
+// ---- Listing cache ----
+
+typedef struct {
+    Listing *l;
+    size_t used, cap;
+    int slots;
+} ListBuild;
+
+static void add_listed(void *arg, int dfd, const char *name, unsigned char type) {
+    (void)dfd;
+    ListBuild *b = arg;
+    Listing *l = b->l;
+    size_t len = strlen(name) + 1;
+    if (b->used + len > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->used + len) cap *= 2;
+        char *names = realloc(l->names, cap);
+        if (!names) return;
+        l->names = names;
+        b->cap = cap;
+    }
+    if (l->n == b->slots) {
+        int slots = b->slots ? b->slots * 2 : 64;
+        unsigned *offs = realloc(l->offs, slots * sizeof(unsigned));
+        if (!offs) return;
+        l->offs = offs;
+        unsigned char *types = realloc(l->types, slots);
+        if (!types) return;
+        l->types = types;
+        b->slots = slots;
+    }
+    memcpy(l->names + b->used, name, len);
+    l->offs[l->n] = b->used;
+    l->types[l->n++] = type;
+    b->used += len;
+}
+
+GlobCache *glob_cache_new(void) {
+    return calloc(1, sizeof(GlobCache));
+}
+
+void glob_cache_free(GlobCache *cache) {
+    if (!cache) return;
+    for (int i = 0; i < GLOB_CACHE_BUCKETS; i++) {
+        CacheEntry *e = cache->buckets[i];
+        while (e) {
+            CacheEntry *next = e->next;
+            free(e->dir);
+            free(e->list.names);
+            free(e->list.offs);
+            free(e->list.types);
+            free(e);
+            e = next;
+        }
+    }
+    free(cache);
+}
+
+static const Listing *cache_list(GlobCache *cache, const char *dir) {
+    unsigned h = 2166136261u;
+    for (const char *p = dir; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    CacheEntry **bucket = &cache->buckets[h & (GLOB_CACHE_BUCKETS - 1)];
+    for (CacheEntry *e = *bucket; e; e = e->next)
+        if (strcmp(e->dir, dir) == 0) return e->ok ? &e->list : NULL;
+
+    CacheEntry *e = calloc(1, sizeof(CacheEntry));
+    if (!e) return NULL;
+    e->dir = strdup(dir);
+    if (!e->dir) {
+        free(e);
+        return NULL;
+    }
+    ListBuild b = { .l = &e->list };
+    e->ok = read_dir(dir, add_listed, &b);
+    e->next = *bucket;
+    *bucket = e;
+    return e->ok ? &e->list : NULL;
+}
+
+// ---- Patterns ----
+
+enum { K_PLAIN, K_MAGIC, K_QUOTED };
+
+static bool posix_class(const char *name, size_t len, int c) {
+    static const struct { const char *name; int (*fn)(int); } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+        { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+        { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+        { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++)
+        if (strlen(classes[i].name) == len && strncmp(classes[i].name, name, len) == 0)
+            return classes[i].fn(c);
+    return false;
+}
+
+// Reads a bracket expression starting after its '['. Returns the index
+// past the closing ']', or -1 when there is none and the '[' is literal.
+static int compile_class(const char *ch, const unsigned char *kind, int i, int n, unsigned char *set) {
+    memset(set, 0, 32);
+    bool neg = false;
+    if (i < n && kind[i] == K_PLAIN && (ch[i] == '!' || ch[i] == '^')) {
+        neg = true;
+        i++;
+    }
+    int first = i;
+    for (; i < n; i++) {
+        if (kind[i] != K_QUOTED && ch[i] == ']' && i > first) break;
+        if (kind[i] != K_QUOTED && ch[i] == '[' && i + 1 < n && ch[i + 1] == ':') {
+            int j = i + 2;
+            while (j + 1 < n && !(ch[j] == ':' && ch[j + 1] == ']')) j++;
+            if (j + 1 < n) {
+                for (int c = 0; c < 256; c++)
+                    if (posix_class(ch + i + 2, j - i - 2, c)) set[c >> 3] |= 1 << (c & 7);
+                i = j + 1;
+                continue;
+            }
+        }
+        unsigned char lo = ch[i], hi = lo;
+        if (i + 2 < n && ch[i + 1] == '-' && kind[i + 1] == K_PLAIN &&
+            !(ch[i + 2] == ']' && kind[i + 2] != K_QUOTED)) {
+            hi = ch[i + 2];
+            i += 2;
+        }
+        for (int c = lo; c <= hi; c++) set[c >> 3] |= 1 << (c & 7);
+    }
+    if (i >= n) return -1;
+    if (neg)
+        for (int k = 0; k < 32; k++) set[k] = ~set[k];
+    set[0] &= ~1;
+    return i + 1;
+}
+
+static void free_pat(GlobPat *p) {
+    free(p->ins);
+    free(p->classes);
+    free(p->text);
+    free(p->suffix);
+}
+
+// Compiles the split_args() text of one path component.
+static bool compile_pat(const char *s, size_t len, GlobPat *p) {
+    memset(p, 0, sizeof(*p));
+    char *ch = malloc(len + 1);
+    unsigned char *kind = malloc(len + 1);
+    int n = 0, nclass = 0;
+    if (!ch || !kind) goto fail;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = s[i];
+        if (c >= '\x04' && c <= '\x07') continue;
+        if (c == '\x10') {
+            if (++i < len) {
+                ch[n] = s[i];
+                kind[n++] = K_QUOTED;
+            }
+            continue;
+        }
+        if (c == '\x01' || c == '\x02' || c == '\x03') {
+            ch[n] = c == '\x01' ? '*' : c == '\x02' ? '?' : '[';
+            kind[n++] = K_MAGIC;
+            if (c == '\x03') nclass++;
+            continue;
+        }
+        ch[n] = c;
+        kind[n++] = K_PLAIN;
+    }
+    ch[n] = '\0';
+
+    p->ins = malloc((n + 1) * sizeof(GInsn));
+    p->classes = nclass ? malloc(nclass * 32) : NULL;
+    if (!p->ins || (nclass && !p->classes)) goto fail;
+    p->literal = true;
+    p->dot = n > 0 && ch[0] == '.' && kind[0] != K_MAGIC;
+    p->globstar = opt_globstar && n == 2 && kind[0] == K_MAGIC && kind[1] == K_MAGIC &&
+                  ch[0] == '*' && ch[1] == '*';
+    int ncls = 0, next;
+    for (int i = 0; i < n;) {
+        GInsn *g = &p->ins[p->n];
+        if (kind[i] == K_MAGIC && ch[i] == '*') {
+            if (p->n == 0 || g[-1].op != G_STAR) {
+                g->op = G_STAR;
+                p->n++;
+            }
+            p->literal = false;
+            i++;
+        } else if (kind[i] == K_MAGIC && ch[i] == '?') {
+            g->op = G_ANY;
+            p->n++;
+            p->literal = false;
+            i++;
+        } else if (kind[i] == K_MAGIC && ch[i] == '[' &&
+                   (next = compile_class(ch, kind, i + 1, n, p->classes[ncls])) > 0) {
+            i = next;
+            g->op = G_CLASS;
+            g->cls = ncls++;
+            p->n++;
+            p->literal = false;
+        } else {
+            g->op = G_CHAR;
+            g->c = ch[i++];
+            p->n++;
+        }
+    }
+    if (p->literal) {
+        p->text = ch;
+        ch = NULL;
+    } else {
+        // The plain text after the last * has to end the name, which
+        // rejects most names of a directory before any backtracking.
+        int k = p->n;
+        while (k > 0 && p->ins[k - 1].op == G_CHAR) k--;
+        if (k > 0 && k < p->n && p->ins[k - 1].op == G_STAR && (p->suffix = malloc(p->n - k + 1))) {
+            for (int i = k; i < p->n; i++) p->suffix[i - k] = p->ins[i].c;
+            p->suffix_len = p->n - k;
+            p->suffix[p->suffix_len] = '\0';
+        }
+    }
+    free(ch);
+    free(kind);
+    return true;
+
+fail:
+    free(ch);
+    free(kind);
+    free_pat(p);
+    return false;
+}
+
+static bool pat_match(const GlobPat *p, const char *s) {
+    if (*s == '.' && !p->dot) return false;
+    if (p->literal) return strcmp(p->text, s) == 0;
+    if (p->suffix) {
+        size_t len = strlen(s);
+        if (len < p->suffix_len || memcmp(s + len - p->suffix_len, p->suffix, p->suffix_len) != 0)
+            return false;
+    }
+    int pi = 0, star = -1;
+    const char *star_s = NULL;
+    while (*s) {
+        if (pi < p->n) {
+            const GInsn *g = &p->ins[pi];
+            unsigned char c = *s;
+            if (g->op == G_STAR) {
+                star = ++pi;
+                star_s = s;
+                continue;
+            }
+            if (g->op == G_ANY || (g->op == G_CHAR && g->c == c) ||
+                (g->op == G_CLASS && (p->classes[g->cls][c >> 3] & (1 << (c & 7))))) {
+                pi++;
+                s++;
+                continue;
+            }
+        }
+        if (star < 0) return false;
+        pi = star;
+        s = ++star_s;
+    }
+    while (pi < p->n && p->ins[pi].op == G_STAR) pi++;
+    return pi == p->n;
+}
+
+static void *arena_dup(Arena *arena, const void *src, size_t size) {
+    if (!src) return NULL;
+    void *dst = arena_alloc(arena, size);
+    if (dst) memcpy(dst, src, size);
+    return dst;
+}
+
+// A case pattern matches a leading dot like any other char, and * and ?
+// match slashes too.
+GlobPat *pattern_compile(Arena *arena, const char *word) {
+    GlobPat tmp;
+    if (!compile_pat(word, strlen(word), &tmp)) return NULL;
+    int ncls = 0;
+    for (int i = 0; i < tmp.n; i++)
+        if (tmp.ins[i].op == G_CLASS) ncls++;
+    GlobPat *p = arena_alloc(arena, sizeof(GlobPat));
+    if (p) {
+        *p = tmp;
+        p->dot = true;
+        p->ins = arena_dup(arena, tmp.ins, (tmp.n + 1) * sizeof(GInsn));
+        p->classes = arena_dup(arena, tmp.classes, (size_t)ncls * 32);
+        p->text = tmp.text ? arena_strdup(arena, tmp.text) : NULL;
+        p->suffix = tmp.suffix ? arena_strdup(arena, tmp.suffix) : NULL;
+    }
+    free_pat(&tmp);
+    return p;
+}
+
+const char *pattern_literal(const GlobPat *p) {
+    return p->literal ? p->text : NULL;
+}
+
+bool pattern_match(const GlobPat *p, const char *s) {
+    return pat_match(p, s);
+}
+
+// ---- ** walks ----
+
+// Every directory below the start is read once by whichever thread pops
+// it. Each thread keeps its own results; they are merged and sorted once
+// the queue is empty and no thread is still reading.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char **queue;
+    int qn, qcap;
+    int busy;
+    int nthreads;
+    bool started;
+    const GlobPat *tail;
+    bool dirs_only;
+    bool links;
+} Walk;
+
+typedef struct {
+    Walk *w;
+    ArgVec found;
+    ArgVec subdirs;
+    const char *dir;
+    bool lead;
+    pthread_t tid;
+} Walker;
+
+static void walk_entry(void *arg, int dfd, const char *name, unsigned char type) {
+    Walker *me = arg;
+    Walk *w = me->w;
+    if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) return;
+    bool hidden = name[0] == '.';
+    bool dir = !hidden && is_dir_at(dfd, name, type, false);
+    if (w->tail) {
+        if (pat_match(w->tail, name)) argv_push(&me->found, join(me->dir, name, false));
+    } else if (!hidden && (!w->dirs_only || dir || (w->links && type == DT_LNK && is_dir_at(dfd, name, type, true)))) {
+        argv_push(&me->found, join(me->dir, name, w->dirs_only));
+    }
+    if (dir && !hidden) argv_push(&me->subdirs, join(me->dir, name, true));
+}
+
+static void *walk_run(void *arg);
+
+static void walk_start_helpers(Walker *walkers) {
+    Walk *w = walkers[0].w;
+    w->started = true;
+    for (int i = 1; i < w->nthreads; i++) {
+        if (pthread_create(&walkers[i].tid, NULL, walk_run, &walkers[i]) != 0) {
+            w->nthreads = i;
+            break;
+        }
+    }
+}
+
+static void *walk_run(void *arg) {
+    Walker *me = arg;
+    Walk *w = me->w;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->qn == 0 && w->busy > 0) pthread_cond_wait(&w->cond, &w->lock);
+        if (w->qn == 0) break;
+        char *dir = w->queue[--w->qn];
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+
+        me->dir = dir;
+        read_dir(dir, walk_entry, me);
+        free(dir);
+
+        pthread_mutex_lock(&w->lock);
+        if (w->qn + me->subdirs.n > w->qcap) {
+            int cap = w->qcap ? w->qcap * 2 : 64;
+            while (cap < w->qn + me->subdirs.n) cap *= 2;
+            char **q = realloc(w->queue, cap * sizeof(char *));
+            if (q) {
+                w->queue = q;
+                w->qcap = cap;
+            }
+        }
+        for (int i = 0; i < me->subdirs.n; i++) {
+            if (w->qn < w->qcap) w->queue[w->qn++] = me->subdirs.v[i];
+            else free(me->subdirs.v[i]);
+        }
+        bool woke = me->subdirs.n > 0;
+        argv_release(&me->subdirs);
+        w->busy--;
+        if (me->lead && !w->started && w->nthreads > 1 && w->qn >= GLOB_PARALLEL_DIRS)
+            walk_start_helpers(me);
+        if (woke || w->busy == 0) pthread_cond_broadcast(&w->cond);
+    }
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static int walk_threads(void) {
+    const char *v = vars_get("CVX_GLOB_THREADS");
+    long n = v && *v ? strtol(v, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    return n > GLOB_MAX_THREADS ? GLOB_MAX_THREADS : (int)n;
+}
+
+// Walks the tree below base, hidden directories aside. With a tail
+// pattern it appends the entries of every directory, base included, that
+// match it; otherwise it appends every entry, or every directory with a
+// trailing slash when dirs_only is set. Symbolic links to directories are
+// never followed, and are only listed as directories when links is set.
+static void walk(const char *base, const GlobPat *tail, bool dirs_only, bool links, ArgVec *out) {
+    Walk w = { .tail = tail, .dirs_only = dirs_only, .links = links, .nthreads = walk_threads() };
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    Walker *walkers = calloc(w.nthreads, sizeof(Walker));
+    w.queue = malloc(sizeof(char *));
+    char *start = strdup(base);
+    if (!walkers || !w.queue || !start) {
+        free(walkers);
+        free(w.queue);
+        free(start);
+        return;
+    }
+    w.queue[w.qn++] = start;
+    w.qcap = 1;
+    walkers[0].lead = true;
+    for (int i = 0; i < w.nthreads; i++) {
+        walkers[i].w = &w;
+        argv_init(&walkers[i].found);
+        argv_init(&walkers[i].subdirs);
+    }
+
+    walk_run(&walkers[0]);
+    for (int i = 1; w.started && i < w.nthreads; i++) pthread_join(walkers[i].tid, NULL);
+
+    for (int i = 0; i < w.nthreads; i++) {
+        for (int k = 0; k < walkers[i].found.n; k++) argv_push(out, walkers[i].found.v[k]);
+        argv_release(&walkers[i].found);
+    }
+    free(walkers);
+    free(w.queue);
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.cond);
+}
+
+// ---- Expansion ----
+
+typedef struct {
+    GlobPat *comps;
+    int n;
+    bool want_dir;
+    GlobCache *cache;
+    ArgVec *out;
+} Glob;
+
+static void glob_from(Glob *g, const char *base, int k);
+
+static void glob_star(Glob *g, const char *base, int k) {
+    if (k == g->n - 1) {
+        // ** matches zero directories too, so base itself is a match.
+        if (*base) argv_push(g->out, strdup(base));
+        walk(base, NULL, g->want_dir, true, g->out);
+        return;
+    }
+    if (k + 1 == g->n - 1 && !g->want_dir && !g->comps[k + 1].globstar) {
+        walk(base, &g->comps[k + 1], false, false, g->out);
+        return;
+    }
+    ArgVec dirs;
+    argv_init(&dirs);
+    walk(base, NULL, true, false, &dirs);
+    glob_from(g, base, k + 1);
+    for (int i = 0; i < dirs.n; i++) glob_from(g, dirs.v[i], k + 1);
+    argv_clear(&dirs);
+}
+
+static void glob_from(Glob *g, const char *base, int k) {
+    const GlobPat *p = &g->comps[k];
+    bool last = k == g->n - 1;
+    if (p->globstar) {
+        glob_star(g, base, k);
+        return;
+    }
+    if (p->literal) {
+        char *path = join(base, p->text, !last);
+        if (!path) return;
+        struct stat st;
+        if (!last) {
+            glob_from(g, path, k + 1);
+        } else if (g->want_dir ? stat(path, &st) == 0 && S_ISDIR(st.st_mode) : lstat(path, &st) == 0) {
+            argv_push(g->out, g->want_dir ? join(path, "", true) : strdup(path));
+        }
+        free(path);
+        return;
+    }
+
+    const Listing *l = cache_list(g->cache, base);
+    if (!l) return;
+    int dfd = -1;
+    for (int i = 0; i < l->n; i++) {
+        const char *name = l->names + l->offs[i];
+        if (!pat_match(p, name)) continue;
+        if (!last || g->want_dir) {
+            unsigned char type = l->types[i];
+            if (type != DT_DIR) {
+                if (dfd < 0) dfd = open(*base ? base : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (dfd < 0 || !is_dir_at(dfd, name, type, true)) continue;
+            }
+        }
+        if (last) {
+            argv_push(g->out, join(base, name, g->want_dir));
+        } else {
+            char *next = join(base, name, true);
+            if (next) glob_from(g, next, k + 1);
+            free(next);
+        }
+    }
+    if (dfd >= 0) close(dfd);
+}
+
+bool glob_has_magic(const char *word) {
+    for (const char *p = word; *p; p++)
+        if (*p == '\x01' || *p == '\x02' || *p == '\x03') return true;
+    return false;
+}
+
+static int path_coll(const void *a, const void *b) {
+    return strcoll(*(char *const *)a, *(char *const *)b);
+}
+
+static int path_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Results are in collation order, which in the C locale is byte order
+// and much cheaper to get with strcmp().
+static bool c_collation(void) {
+    const char *lc = setlocale(LC_COLLATE, NULL);
+    return !lc || strcmp(lc, "C") == 0 || strcmp(lc, "POSIX") == 0;
+}
+
+// Compiles the path components of word into g.
+static bool glob_compile(const char *word, Glob *g) {
+    int ncomps = 1;
+    for (const char *p = word; *p; p++)
+        if (*p == '/') ncomps++;
+    g->comps = calloc(ncomps, sizeof(GlobPat));
+    if (!g->comps) return false;
+
+    const char *p = word;
+    while (*p) {
+        const char *end = strchrnul(p, '/');
+        if (end > p) {
+            if (!compile_pat(p, end - p, &g->comps[g->n])) return false;
+            g->n++;
+        }
+        g->want_dir = *end == '/';
+        p = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+static void glob_release(Glob *g) {
+    for (int i = 0; i < g->n; i++) free_pat(&g->comps[i]);
+    free(g->comps);
+}
+
+bool glob_expand(const char *word, GlobCache *cache, ArgVec *out) {
+    Glob g = { .cache = cache, .out = out };
+    int start = out->n;
+    if (glob_compile(word, &g) && g.n > 0) {
+        glob_from(&g, word[0] == '/' ? "/" : "", 0);
+        if (!opt_nosortglob)
+            qsort(out->v + start, out->n - start, sizeof(char *), c_collation() ? path_cmp : path_coll);
+    }
+    glob_release(&g);
+    return out->n > start;
+}
+
+// ---- Streams ----
+
+struct GlobStream {
+    GlobPat pat;
+    bool want_dir;
+    bool matched;
+    bool done;
+    char *word;
+    int fd;
+    char *buf;
+    long len, off;
+    char *path;
+    size_t base_len, cap;
+};
+
+GlobStream *glob_stream_open(const char *word) {
+    Glob g = { 0 };
+    GlobStream *s = NULL;
+    bool ok = glob_compile(word, &g) && g.n > 0 &&
+              !g.comps[g.n - 1].literal && !g.comps[g.n - 1].globstar;
+    for (int i = 0; ok && i < g.n - 1; i++) ok = g.comps[i].literal;
+    if (ok) s = calloc(1, sizeof(GlobStream));
+    if (!s) {
+        glob_release(&g);
+        return NULL;
+    }
+
+    size_t cap = strlen(word) + 2;
+    s->path = malloc(cap);
+    s->word = strdup(word);
+    s->buf = malloc(DENTS_BUF);
+    s->fd = -1;
+    if (!s->path || !s->word || !s->buf) {
+        glob_release(&g);
+        glob_stream_close(s);
+        return NULL;
+    }
+    s->cap = cap;
+    if (word[0] == '/') s->path[s->base_len++] = '/';
+    for (int i = 0; i < g.n - 1; i++) {
+        size_t len = strlen(g.comps[i].text);
+        memcpy(s->path + s->base_len, g.comps[i].text, len);
+        s->base_len += len;
+        s->path[s->base_len++] = '/';
+    }
+    s->path[s->base_len] = '\0';
+    s->pat = g.comps[g.n - 1];
+    g.n--;
+    s->want_dir = g.want_dir;
+    glob_release(&g);
+
+    for (char *p = s->word; *p; p++) {
+        if (*p == '\x01') *p = '*';
+        else if (*p == '\x02') *p = '?';
+        else if (*p == '\x03') *p = '[';
+    }
+    quote_removal(&s->word, 1);
+    s->fd = open(s->base_len ? s->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return s;
+}
+
+// Returns the next match in directory order, valid until the next call,
+// or the word itself once if nothing matched.
+const char *glob_stream_next(GlobStream *s) {
+    while (s->fd >= 0) {
+        if (s->off >= s->len) {
+            s->len = syscall(SYS_getdents64, s->fd, s->buf, DENTS_BUF);
+            s->off = 0;
+            if (s->len <= 0) {
+                close(s->fd);
+                s->fd = -1;
+                break;
+            }
+        }
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(s->buf + s->off);
+        s->off += d->d_reclen;
+        if (!pat_match(&s->pat, d->d_name)) continue;
+        if (s->want_dir && !is_dir_at(s->fd, d->d_name, d->d_type, true)) continue;
+
+        size_t len = strlen(d->d_name);
+        if (s->base_len + len + 2 > s->cap) {
+            size_t cap = (s->base_len + len + 2) * 2;
+            char *path = realloc(s->path, cap);
+            if (!path) continue;
+            s->path = path;
+            s->cap = cap;
+        }
+        memcpy(s->path + s->base_len, d->d_name, len);
+        if (s->want_dir) s->path[s->base_len + len++] = '/';
+        s->path[s->base_len + len] = '\0';
+        s->matched = true;
+        return s->path;
+    }
+    if (s->matched || s->done) return NULL;
+    s->done = true;
+    return s->word;
+}
+
+void glob_stream_close(GlobStream *s) {
+    if (!s) return;
+    if (s->fd >= 0) close(s->fd);
+    free_pat(&s->pat);
+    free(s->word);
+    free(s->buf);
+    free(s->path);
+    free(s);
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef FILEGLOB_H
+#define FILEGLOB_H
+
+#include <stdbool.h>
+#include "utils.h"
+#include "arena.h"
+
+// Pathname expansion over split_args() words. Only the \x01 \x02 \x03
+// markers are wildcards; quoted and escaped text always matches itself.
+// Each word is compiled once per path component and matched against
+// directory listings that are read with getdents64() and kept in a
+// GlobCache, so every pattern in one command shares a single read of
+// each directory. With globstar set, a lone ** component matches any
+// number of directories, and deep trees are walked by several threads.
+GlobCache *glob_cache_new(void);
+void glob_cache_free(GlobCache *cache);
+bool glob_has_magic(const char *word);
+
+// Appends the paths word matches to out, sorted, and returns true, or
+// returns false without appending anything when nothing matches.
+bool glob_expand(const char *word, GlobCache *cache, ArgVec *out);
+
+// With nosortglob, a word whose wildcards are all in its last component
+// can be read as a stream: one directory, in the order the directory
+// lists it, one getdents64() buffer at a time. glob_stream_open()
+// returns NULL for any other word.
+typedef struct GlobStream GlobStream;
+
+GlobStream *glob_stream_open(const char *word);
+const char *glob_stream_next(GlobStream *s);
+void glob_stream_close(GlobStream *s);
+
+// Compiled case patterns, allocated from the arena of the tree they
+// belong to. pattern_literal() is the text a pattern without wildcards
+// matches, or NULL.
+typedef struct GlobPat GlobPat;
+
+GlobPat *pattern_compile(Arena *arena, const char *word);
+const char *pattern_literal(const GlobPat *p);
+bool pattern_match(const GlobPat *p, const char *s);
+
+#endif
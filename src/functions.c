@@ -9,21 +9,46 @@
 #include <stdlib.h>
 #include <string.h>
 #include "functions.h"
+#include "parser.h"
+#include "out.h"
 
 typedef struct shell_function {
     char *name;
-    char *body;
+    function_body_t *body;
     struct shell_function *next;
 } shell_function_t;
 
 static shell_function_t *functions_head = NULL;
 
+static function_body_t *compile_body(const char *text) {
+    function_body_t *body = malloc(sizeof(function_body_t));
+    body->text = strdup(text);
+    arena_init(&body->arena);
+    body->ast = parse_ast(text, &body->arena);
+    body->prog = vm_compile(body->ast);
+    body->refs = 0;
+    body->detached = false;
+    return body;
+}
+
+static void free_body(function_body_t *body) {
+    vm_free(body->prog);
+    arena_release(&body->arena);
+    free(body->text);
+    free(body);
+}
+
+static void detach_body(function_body_t *body) {
+    if (body->refs > 0) body->detached = true;
+    else free_body(body);
+}
+
 void add_function(const char *name, const char *body) {
     shell_function_t *curr = functions_head;
     while (curr) {
         if (strcmp(curr->name, name) == 0) {
-            free(curr->body);
-            curr->body = strdup(body);
+            detach_body(curr->body);
+            curr->body = compile_body(body);
             return;
         }
         curr = curr->next;
@@ -31,22 +56,39 @@ void add_function(const char *name, const char *body) {
 
     shell_function_t *new_func = malloc(sizeof(shell_function_t));
     new_func->name = strdup(name);
-    new_func->body = strdup(body);
+    new_func->body = compile_body(body);
     new_func->next = functions_head;
     functions_head = new_func;
 }
 
-const char* get_function(const char *name) {
+static shell_function_t *find_function(const char *name) {
     shell_function_t *curr = functions_head;
     while (curr) {
         if (strcmp(curr->name, name) == 0) {
-            return curr->body;
+            return curr;
         }
         curr = curr->next;
     }
     return NULL;
 }
 
+bool has_function(const char *name) {
+    return find_function(name) != NULL;
+}
+
+function_body_t *acquire_function(const char *name) {
+    shell_function_t *func = find_function(name);
+    if (!func) return NULL;
+    func->body->refs++;
+    return func->body;
+}
+
+void release_function(function_body_t *body) {
+    if (!body) return;
+    body->refs--;
+    if (body->refs == 0 && body->detached) free_body(body);
+}
+
 void remove_function(const char *name) {
     shell_function_t *curr = functions_head;
     shell_function_t *prev = NULL;
@@ -59,7 +101,7 @@ void remove_function(const char *name) {
                 functions_head = curr->next;
             }
             free(curr->name);
-            free(curr->body);
+            detach_body(curr->body);
             free(curr);
             return;
         }
@@ -73,7 +115,7 @@ int cmd_functions(int argc, char **argv) {
     (void)argv;
     shell_function_t *curr = functions_head;
     while (curr) {
-        printf("%s() {\n%s\n}\n", curr->name, curr->body);
+        out_printf("%s() {\n%s\n}\n", curr->name, curr->body->text);
         curr = curr->next;
     }
     return 0;
@@ -81,7 +123,7 @@ int cmd_functions(int argc, char **argv) {
 
 int cmd_delfunc(int argc, char **argv) {
     if (argc < 2) {
-        printf("Usage: delfunc <name>\n");
+        out_printf("Usage: delfunc <name>\n");
         return 1;
     }
     remove_function(argv[1]);
@@ -7,8 +7,27 @@
 #ifndef FUNCTIONS_H
 #define FUNCTIONS_H
 
+#include <stdbool.h>
+#include "ast.h"
+#include "vm.h"
+#include "arena.h"
+
+// Body of a shell function, parsed and compiled once when the definition runs.
+// Calls hold a reference so a function can redefine or delete itself
+// while it is executing without freeing the tree under its own feet.
+typedef struct function_body {
+    char *text;
+    Arena arena;
+    ASTNode *ast;
+    Program *prog;
+    int refs;
+    bool detached;
+} function_body_t;
+
 void add_function(const char *name, const char *body);
-const char* get_function(const char *name);
+bool has_function(const char *name);
+function_body_t *acquire_function(const char *name);
+void release_function(function_body_t *body);
 void remove_function(const char *name);
 int cmd_functions(int argc, char **argv);
 int cmd_delfunc(int argc, char **argv);
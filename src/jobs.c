@@ -3,10 +3,19 @@
 // All original author information and file headers must be preserved.
 // For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
 
+#define _GNU_SOURCE
 #include "jobs.h"
+#include "out.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #define MAX_JOBS 32
@@ -38,7 +47,7 @@ void jobs_list(void) {
         const char *state =
             (jobs[i].state == JOB_RUNNING) ? "Running" : "Stopped";
 
-        printf("[%d] %-8s %s\n",
+        out_printf("[%d] %-8s %s\n",
                jobs[i].id,
                state,
                jobs[i].cmd);
@@ -85,3 +94,251 @@ void jobs_set_state(pid_t pgid, job_state_t state) {
         }
     }
 }
+
+// ---- Worker pools ----
+
+typedef struct {
+    pid_t pid;
+    int task;
+    int out_fd, err_fd;
+} PoolSlot;
+
+// The output of a task that ended before an earlier one.
+typedef struct {
+    char *out, *err;
+    size_t out_len, err_len;
+    bool done;
+} PoolHeld;
+
+struct JobPool {
+    PoolSlot *slots;
+    int nslots, running, cur;
+    int flags;
+    int started, emitted;
+    PoolHeld *held;
+    int held_cap;
+    int fail_task, status;
+    bool stopped;
+    sigset_t old_mask;
+};
+
+// Parses a job count; 0 means one per CPU. Returns -1 when arg is not a
+// number.
+int pool_size(const char *arg) {
+    char *end;
+    long n = strtol(arg, &end, 10);
+    if (!*arg || *end || n < 0 || n > 4096) return -1;
+    if (n == 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+JobPool *pool_new(int slots, int flags) {
+    JobPool *p = calloc(1, sizeof(JobPool));
+    if (!p) return NULL;
+    p->slots = calloc(slots, sizeof(PoolSlot));
+    if (!p->slots) {
+        free(p);
+        return NULL;
+    }
+    p->nslots = slots;
+    p->flags = flags;
+    p->fail_task = INT_MAX;
+    for (int i = 0; i < slots; i++) {
+        p->slots[i].out_fd = p->slots[i].err_fd = -1;
+        if (flags & POOL_CAPTURE) {
+            p->slots[i].out_fd = memfd_create("cvx-pool", MFD_CLOEXEC);
+            p->slots[i].err_fd = memfd_create("cvx-pool", MFD_CLOEXEC);
+        }
+    }
+    out_flush();
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &p->old_mask);
+    return p;
+}
+
+static void write_all(int fd, const char *s, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, s, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        s += w;
+        n -= w;
+    }
+}
+
+static void copy_out(int from, int to) {
+    struct stat st;
+    if (fstat(from, &st) < 0) return;
+    off_t off = 0;
+    while (off < st.st_size) {
+        ssize_t n = sendfile(to, from, &off, st.st_size - off);
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        // Some outputs, such as files opened for appending, refuse
+        // sendfile(); copy the rest by hand.
+        char buf[8192];
+        while ((n = pread(from, buf, sizeof(buf), off)) > 0) {
+            write_all(to, buf, n);
+            off += n;
+        }
+        break;
+    }
+}
+
+static char *slurp(int fd, size_t *len) {
+    struct stat st;
+    *len = 0;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) return NULL;
+    char *buf = malloc(st.st_size);
+    if (!buf) return NULL;
+    ssize_t n = pread(fd, buf, st.st_size, 0);
+    *len = n > 0 ? (size_t)n : 0;
+    return buf;
+}
+
+static void reset_fd(int fd) {
+    if (fd < 0) return;
+    if (ftruncate(fd, 0) < 0) return;
+    lseek(fd, 0, SEEK_SET);
+}
+
+static void emit_held(PoolHeld *h) {
+    write_all(STDOUT_FILENO, h->out, h->out_len);
+    write_all(STDERR_FILENO, h->err, h->err_len);
+    free(h->out);
+    free(h->err);
+    memset(h, 0, sizeof(*h));
+}
+
+static void pool_done(JobPool *p, PoolSlot *s, int status) {
+    if (status != 0 && !p->stopped && s->task < p->fail_task) {
+        p->fail_task = s->task;
+        p->status = status;
+    }
+    if (status != 0 && (p->flags & POOL_FAIL_FAST) && !p->stopped) {
+        p->stopped = true;
+        for (int i = 0; i < p->nslots; i++)
+            if (p->slots[i].pid > 0 && &p->slots[i] != s) kill(p->slots[i].pid, SIGTERM);
+    }
+
+    if (p->flags & POOL_CAPTURE) {
+        if (!(p->flags & POOL_ORDERED) || s->task == p->emitted) {
+            copy_out(s->out_fd, STDOUT_FILENO);
+            copy_out(s->err_fd, STDERR_FILENO);
+            if (p->flags & POOL_ORDERED) {
+                p->emitted++;
+                while (p->emitted < p->started && p->held[p->emitted & (p->held_cap - 1)].done)
+                    emit_held(&p->held[p->emitted++ & (p->held_cap - 1)]);
+            }
+        } else {
+            PoolHeld *h = &p->held[s->task & (p->held_cap - 1)];
+            h->out = slurp(s->out_fd, &h->out_len);
+            h->err = slurp(s->err_fd, &h->err_len);
+            h->done = true;
+        }
+        reset_fd(s->out_fd);
+        reset_fd(s->err_fd);
+    }
+    s->pid = 0;
+    p->running--;
+}
+
+// Waits for one task to end. Only the pool's own children are reaped;
+// SIGCHLD is taken with sigwaitinfo() and each running task polled, so
+// background jobs that end meanwhile are left for the handler.
+static void pool_wait(JobPool *p) {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    for (;;) {
+        for (int i = 0; i < p->nslots; i++) {
+            PoolSlot *s = &p->slots[i];
+            if (s->pid <= 0) continue;
+            int wstatus;
+            pid_t pid = waitpid(s->pid, &wstatus, WNOHANG);
+            if (pid == 0) continue;
+            int status = pid < 0 ? 1 : WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+            pool_done(p, s, status);
+            return;
+        }
+        sigwaitinfo(&chld, NULL);
+    }
+}
+
+// Makes room in the ring of held output for one more task.
+static bool grow_held(JobPool *p) {
+    if (p->started - p->emitted < p->held_cap) return true;
+    int cap = p->held_cap ? p->held_cap * 2 : 64;
+    PoolHeld *held = calloc(cap, sizeof(PoolHeld));
+    if (!held) return false;
+    for (int t = p->emitted; t < p->started; t++)
+        held[t & (cap - 1)] = p->held[t & (p->held_cap - 1)];
+    free(p->held);
+    p->held = held;
+    p->held_cap = cap;
+    return true;
+}
+
+// Waits for a free slot. Returns false once the pool has stopped;
+// otherwise the next task should write to *out_fd and *err_fd, which are
+// -1 when output is not captured.
+bool pool_next(JobPool *p, int *out_fd, int *err_fd) {
+    while (!p->stopped && p->running == p->nslots) pool_wait(p);
+    if (p->stopped) return false;
+    if ((p->flags & POOL_ORDERED) && !grow_held(p)) return false;
+    int i = 0;
+    while (p->slots[i].pid > 0) i++;
+    p->cur = i;
+    *out_fd = p->slots[i].out_fd;
+    *err_fd = p->slots[i].err_fd;
+    return true;
+}
+
+// Records the child started for the slot pool_next() handed out; a pid
+// below 0 is a task that could not start.
+void pool_started(JobPool *p, pid_t pid) {
+    PoolSlot *s = &p->slots[p->cur];
+    s->task = p->started++;
+    if (p->flags & POOL_ORDERED) p->held[s->task & (p->held_cap - 1)].done = false;
+    p->running++;
+    if (pid > 0) s->pid = pid;
+    else pool_done(p, s, 1);
+}
+
+// Sets up a forked task: the signal mask from before the pool, stdin
+// from /dev/null as for any background command, and the slot's output.
+void pool_child(const JobPool *p, int out_fd, int err_fd) {
+    sigprocmask(SIG_SETMASK, &p->old_mask, NULL);
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        if (null_fd != STDIN_FILENO) close(null_fd);
+    }
+    if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+    if (err_fd >= 0) dup2(err_fd, STDERR_FILENO);
+}
+
+// Waits for every task, copies out what is left and closes the pool.
+int pool_finish(JobPool *p) {
+    while (p->running > 0) pool_wait(p);
+    if (p->flags & POOL_ORDERED) {
+        while (p->emitted < p->started) {
+            PoolHeld *h = &p->held[p->emitted++ & (p->held_cap - 1)];
+            if (h->done) emit_held(h);
+        }
+    }
+    for (int i = 0; i < p->nslots; i++) {
+        if (p->slots[i].out_fd >= 0) close(p->slots[i].out_fd);
+        if (p->slots[i].err_fd >= 0) close(p->slots[i].err_fd);
+    }
+    sigprocmask(SIG_SETMASK, &p->old_mask, NULL);
+    // A SIGCHLD taken while waiting may have been for a background job.
+    raise(SIGCHLD);
+    int status = p->status;
+    free(p->held);
+    free(p->slots);
+    free(p);
+    return status;
+}
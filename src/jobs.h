@@ -6,6 +6,8 @@
 #ifndef JOBS_H
 #define JOBS_H
 
+#include <stdbool.h>
+#include <signal.h>
 #include <sys/types.h>
 
 typedef enum {
@@ -21,4 +23,27 @@ int jobs_last_id(void);
 void jobs_cleanup(void);
 void jobs_set_state(pid_t pgid, job_state_t state);
 
+// A pool of at most N children running numbered tasks, for for -j and
+// pmap. With POOL_CAPTURE a task's stdout and stderr go to memfds owned
+// by its slot and are copied out whole when it ends; POOL_ORDERED holds
+// them back until every earlier task has been copied out. SIGCHLD stays
+// blocked while the pool is open so the handler cannot reap a task.
+// The status is that of the first task, in task order, that failed; with
+// POOL_FAIL_FAST it is that of the first failure seen, no task starts
+// after it and the running ones are sent SIGTERM.
+typedef struct JobPool JobPool;
+
+enum {
+    POOL_CAPTURE = 1,
+    POOL_ORDERED = 2,
+    POOL_FAIL_FAST = 4
+};
+
+int pool_size(const char *arg);
+JobPool *pool_new(int slots, int flags);
+bool pool_next(JobPool *p, int *out_fd, int *err_fd);
+void pool_started(JobPool *p, pid_t pid);
+void pool_child(const JobPool *p, int out_fd, int err_fd);
+int pool_finish(JobPool *p);
+
 #endif
@@ -13,13 +13,52 @@
 typedef struct {
     Token *head;
     Token *tail;
+    Arena *arena;
 } LexerCtx;
 
-static void add_tok(LexerCtx *ctx, TokenType t, const char *val, int len) {
-    Token *tok = calloc(1, sizeof(Token));
-    if (!tok) return; // Zawsze warto sprawdzić przy calloc
+// Perfect hash over the reserved words: (first + 2 * last + 6 * len) & 31
+// is collision free for this set, so a lookup costs one memcmp.
+typedef struct {
+    const char *word;
+    TokenType type;
+} Keyword;
+
+static const Keyword keyword_table[32] = {
+    [1]  = { "if",    TOK_IF },
+    [3]  = { "esac",  TOK_ESAC },
+    [4]  = { "fi",    TOK_FI },
+    [5]  = { "case",  TOK_CASE },
+    [6]  = { "done",  TOK_DONE },
+    [7]  = { "else",  TOK_ELSE },
+    [8]  = { "then",  TOK_THEN },
+    [9]  = { "elif",  TOK_ELIF },
+    [11] = { "until", TOK_UNTIL },
+    [14] = { "do",    TOK_DO },
+    [17] = { "in",    TOK_IN },
+    [28] = { "for",   TOK_FOR },
+    [31] = { "while", TOK_WHILE },
+};
+
+static TokenType keyword_type(const char *s, int len) {
+    if (len < 2 || len > 5) return TOK_STR;
+    unsigned h = ((unsigned char)s[0] + 2u * (unsigned char)s[len - 1] + 6u * (unsigned)len) & 31;
+    const Keyword *kw = &keyword_table[h];
+    if (kw->word && (int)strlen(kw->word) == len && memcmp(kw->word, s, len) == 0)
+        return kw->type;
+    return TOK_STR;
+}
+
+bool is_reserved_word(const char *s) {
+    return keyword_type(s, strlen(s)) != TOK_STR;
+}
+
+static Token *add_tok(LexerCtx *ctx, TokenType t, const char *start, int len) {
+    Token *tok = arena_alloc(ctx->arena, sizeof(Token));
+    if (!tok) return NULL;
     tok->type = t;
-    if (val) tok->val = strndup(val, len);
+    tok->start = start;
+    tok->len = len;
+    tok->next = NULL;
     
     if (!ctx->head) {
         ctx->head = ctx->tail = tok;
@@ -27,10 +66,11 @@ static void add_tok(LexerCtx *ctx, TokenType t, const char *val, int len) {
         ctx->tail->next = tok;
         ctx->tail = tok;
     }
+    return tok;
 }
 
-Token *tokenize(const char *line) {
-    LexerCtx ctx = {NULL, NULL};
+Token *tokenize(const char *line, Arena *arena) {
+    LexerCtx ctx = {NULL, NULL, arena};
     const char *p = line;
 
     while (*p) {
@@ -47,11 +87,29 @@ Token *tokenize(const char *line) {
         if (strncmp(p, ";;", 2) == 0) { add_tok(&ctx, TOK_DSEMI, NULL, 0); p += 2; continue; }
         if (*p == '|') { add_tok(&ctx, TOK_PIPE, NULL, 0); p++; continue; }
         if (*p == '&') { add_tok(&ctx, TOK_AMP, NULL, 0); p++; continue; }
+        if (*p == '(' && p[1] == '(') {
+            // (( expr )) is one token holding the expression; a (( whose
+            // first unmatched ) is not doubled is two subshell parens.
+            const char *q = p + 2;
+            int depth = 0;
+            while (*q && !(*q == ')' && depth == 0)) {
+                if (*q == '(') depth++;
+                else if (*q == ')') depth--;
+                q++;
+            }
+            if (*q == ')' && q[1] == ')') {
+                add_tok(&ctx, TOK_ARITH, p + 2, q - (p + 2));
+                p = q + 2;
+                continue;
+            }
+        }
         if (*p == '(') { add_tok(&ctx, TOK_LPAREN, NULL, 0); p++; continue; }
         if (*p == ')') { add_tok(&ctx, TOK_RPAREN, NULL, 0); p++; continue; }
-        if (*p == '!') { add_tok(&ctx, TOK_BANG, "!", 1); p++; continue; }
+        if (*p == '!') { add_tok(&ctx, TOK_BANG, p, 1); p++; continue; }
 
-        if (*p == '{') {
+        // { only opens a group as a word of its own; {a,b}, {} and
+        // ${x} are words.
+        if (*p == '{' && (p[1] == ' ' || p[1] == '\t' || p[1] == '\n' || p[1] == '\0')) {
             const char *start = p + 1;
             int depth = 1;
             bool b_in_quotes = false;
@@ -89,7 +147,8 @@ Token *tokenize(const char *line) {
             if (!ctx.tail || ctx.tail->type != TOK_SEMI) {
                 add_tok(&ctx, TOK_SEMI, NULL, 0);
             }
-            while (*p == '\n' || *p == ';' || *p == ' ' || *p == '\t') p++;
+            // A ;; after a newline still ends a case arm.
+            while (*p == '\n' || (*p == ';' && p[1] != ';') || *p == ' ' || *p == '\t') p++;
             continue;
         }
 
@@ -113,7 +172,7 @@ Token *tokenize(const char *line) {
                 } else if (p_depth == 0) {
                     if (*p == ' ' || *p == '\t' || *p == '\n' ||
                         *p == ';' || *p == '|' || *p == '&' ||
-                        *p == '(' || *p == ')' || *p == '{' || *p == '}') break;
+                        *p == '(' || *p == ')') break;
                 }
             } else {
                 if (quote_char == '"' && *p == '$' && p[1] == '(') {
@@ -137,23 +196,7 @@ Token *tokenize(const char *line) {
         }
 
         if (p > start) {
-            char *s = strndup(start, p - start);
-            TokenType t = TOK_STR;
-            if (strcmp(s, "if") == 0) t = TOK_IF;
-            else if (strcmp(s, "then") == 0) t = TOK_THEN;
-            else if (strcmp(s, "else") == 0) t = TOK_ELSE;
-            else if (strcmp(s, "elif") == 0) t = TOK_ELIF;
-            else if (strcmp(s, "fi") == 0) t = TOK_FI;
-            else if (strcmp(s, "case") == 0) t = TOK_CASE;
-            else if (strcmp(s, "in") == 0) t = TOK_IN;
-            else if (strcmp(s, "esac") == 0) t = TOK_ESAC;
-            else if (strcmp(s, "for") == 0) t = TOK_FOR;
-            else if (strcmp(s, "while") == 0) t = TOK_WHILE;
-            else if (strcmp(s, "until") == 0) t = TOK_UNTIL;
-            else if (strcmp(s, "do") == 0) t = TOK_DO;
-            else if (strcmp(s, "done") == 0) t = TOK_DONE;
-            add_tok(&ctx, t, s, p - start);
-            free(s);
+            add_tok(&ctx, keyword_type(start, p - start), start, p - start);
         } else {
             p++;
         }
@@ -163,15 +206,6 @@ Token *tokenize(const char *line) {
 }
 
 
-void free_tokens(Token *head) {
-    while(head) {
-        Token *t = head;
-        head = head->next;
-        free(t->val);
-        free(t);
-    }
-}
-
 bool match(Token **token, TokenType type) {
     if ((*token)->type == type) {
         *token = (*token)->next;
@@ -184,119 +218,261 @@ void consume(Token **token) {
     if ((*token)->type != TOK_EOF) *token = (*token)->next;
 }
 
-char *concat_tokens(Token *start, Token *end) {
-    int len = 0;
+static const char *operator_text(TokenType type) {
+    switch (type) {
+        case TOK_AND: return "&&";
+        case TOK_OR: return "||";
+        case TOK_PIPE: return "|";
+        case TOK_SEMI: return ";";
+        case TOK_AMP: return "&";
+        case TOK_DSEMI: return ";;";
+        default: return "";
+    }
+}
+
+char *concat_tokens(Arena *arena, Token *start, Token *end) {
+    size_t len = 0;
     for (Token *t = start; t != end; t = t->next) {
-        if (t->val) len += strlen(t->val) + 1;
-        else len += 4;
+        len += t->start ? (size_t)t->len : strlen(operator_text(t->type));
+        if (t->next != end) len++;
     }
-    if (len == 0) return strdup("");
-    char *res = malloc(len + 1);
-    res[0] = '\0';
+    char *res = arena_alloc(arena, len + 1);
+    if (!res) return NULL;
+    char *w = res;
     for (Token *t = start; t != end; t = t->next) {
-        if (t->val) {
-            strcat(res, t->val);
+        if (t->start) {
+            memcpy(w, t->start, t->len);
+            w += t->len;
         } else {
-            if (t->type == TOK_AND) strcat(res, "&&");
-            else if (t->type == TOK_OR) strcat(res, "||");
-            else if (t->type == TOK_PIPE) strcat(res, "|");
-            else if (t->type == TOK_SEMI) strcat(res, ";");
-            else if (t->type == TOK_AMP) strcat(res, "&");
-            else if (t->type == TOK_DSEMI) strcat(res, ";;");
+            const char *op = operator_text(t->type);
+            size_t n = strlen(op);
+            memcpy(w, op, n);
+            w += n;
         }
-        if (t->next != end) strcat(res, " ");
+        if (t->next != end) *w++ = ' ';
     }
+    *w = '\0';
     return res;
 }
 
-bool is_block_complete(const char *line) {
-    if (!line) return true;
+char *token_strdup(Arena *arena, const Token *tok) {
+    if (!tok->start) return arena_strdup(arena, operator_text(tok->type));
+    return arena_strndup(arena, tok->start, tok->len);
+}
+
+static bool is_word_break(char c) {
+    return c == ' ' || c == '\t' || c == ';' || c == '|' || c == '&' ||
+           c == '(' || c == ')';
+}
+
+static void word_char(BlockState *st, char c, bool plain) {
+    if (st->word_len < (int)sizeof(st->word)) st->word[st->word_len] = c;
+    st->word_len++;
+    if (!plain) st->word_plain = false;
+}
+
+// Same rule tokenize() applies: only a bare word outside { } and $( )
+// can open or close a compound command.
+static void end_word(BlockState *st) {
+    if (st->word_len > 0 && st->word_plain && st->brace_depth <= 0 && st->subst_depth == 0) {
+        switch (keyword_type(st->word, st->word_len)) {
+            case TOK_IF: st->if_depth++; break;
+            case TOK_FI: st->if_depth--; break;
+            case TOK_CASE: st->case_depth++; break;
+            case TOK_ESAC: st->case_depth--; break;
+            case TOK_FOR:
+            case TOK_WHILE:
+            case TOK_UNTIL: st->loop_depth++; break;
+            case TOK_DONE: st->loop_depth--; break;
+            default: break;
+        }
+    }
+    st->word_len = 0;
+    st->word_plain = true;
+}
+
+static const char *read_heredoc_delim(BlockState *st, const char *q, const char *end) {
+    while (q < end && (*q == ' ' || *q == '\t')) q++;
+    bool strip = false;
+    if (q < end && *q == '-') {
+        strip = true;
+        q++;
+        while (q < end && (*q == ' ' || *q == '\t')) q++;
+    }
+    bool qdel = q < end && (*q == '\'' || *q == '"');
+    char qch = qdel ? *q++ : 0;
+    char delim[HEREDOC_DELIM_MAX] = {0};
+    int di = 0;
+    while (q < end && di < HEREDOC_DELIM_MAX - 1) {
+        if (qdel && *q == qch) { q++; break; }
+        if (!qdel && (*q == ' ' || *q == '\t' || *q == ';' || *q == '|' ||
+            *q == '&' || *q == ')' || *q == '<' || *q == '>')) break;
+        delim[di++] = *q++;
+    }
+    if (di > 0 && st->heredocs < HEREDOC_PENDING_MAX) {
+        memcpy(st->heredoc_delim[st->heredocs], delim, di + 1);
+        st->heredoc_strip[st->heredocs] = strip;
+        st->heredocs++;
+    }
+    return q;
+}
+
+static void heredoc_line(BlockState *st, const char *p, const char *end) {
+    if (st->heredoc_strip[0]) while (p < end && *p == '\t') p++;
+    size_t n = strlen(st->heredoc_delim[0]);
+    if ((size_t)(end - p) != n || memcmp(p, st->heredoc_delim[0], n) != 0) return;
+
+    st->heredocs--;
+    memmove(st->heredoc_delim[0], st->heredoc_delim[1], sizeof(st->heredoc_delim[0]) * st->heredocs);
+    memmove(st->heredoc_strip, st->heredoc_strip + 1, sizeof(st->heredoc_strip[0]) * st->heredocs);
+    if (st->heredocs == 0) st->in_heredoc = false;
+}
+
+static void feed_line(BlockState *st, const char *line, const char *end) {
+    if (st->in_heredoc) {
+        heredoc_line(st, line, end);
+        return;
+    }
 
-    int brace_depth = 0;
-    bool in_sq = false;
-    bool in_dq = false;
     const char *p = line;
-    const char *last_op_pos = NULL;
+    while (p < end) {
+        char c = *p;
 
-    while (*p) {
-        if (!in_sq && *p == '\\') {
+        if (st->in_sq) {
+            if (c == '\'') st->in_sq = false;
+            p++;
+            continue;
+        }
+        if (c == '\\') {
+            word_char(st, c, false);
+            // A backslash ending the line joins it with the next one.
+            st->pending_op = (p + 1 == end);
+            p += (p + 1 < end) ? 2 : 1;
+            continue;
+        }
+        if (st->in_dq) {
+            if (c == '"') st->in_dq = false;
+            p++;
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            if (c == '\'') st->in_sq = true; else st->in_dq = true;
+            word_char(st, c, false);
+            st->pending_op = false;
+            p++;
+            continue;
+        }
+        if (c == '$' && p + 1 < end && p[1] == '(') {
+            word_char(st, c, false);
+            st->subst_depth++;
+            st->pending_op = false;
+            p += 2;
+            continue;
+        }
+        if (c == '(' && p + 1 < end && p[1] == '(' && st->subst_depth == 0) {
+            // (( )) counts like $(( )), so << inside it is a shift.
+            end_word(st);
+            word_char(st, c, false);
+            st->subst_depth += 2;
+            st->pending_op = false;
+            p += 2;
+            continue;
+        }
+        if (st->subst_depth > 0) {
+            if (c == '(') st->subst_depth++;
+            else if (c == ')') st->subst_depth--;
+            word_char(st, c, false);
+            p++;
+            continue;
+        }
+        if (c == '#' && st->word_len == 0 &&
+            (p == line || p[-1] == ' ' || p[-1] == '\t' || p[-1] == ';' ||
+             p[-1] == '|' || p[-1] == '&' || p[-1] == '(' || p[-1] == ')')) {
+            break;
+        }
+        if (c == '<' && p + 1 < end && p[1] == '<' &&
+            !(p + 2 < end && (p[2] == '<' || p[2] == '>'))) {
+            end_word(st);
+            st->pending_op = false;
+            p = read_heredoc_delim(st, p + 2, end);
+            continue;
+        }
+        // Same rule as tokenize(): a group opens at a lone { and closes
+        // at a } that starts a word.
+        if (c == '{' && st->word_len == 0 && (p + 1 == end || p[1] == ' ' || p[1] == '\t')) {
+            st->brace_depth++;
+            st->pending_op = false;
+            p++;
+            continue;
+        }
+        if (c == '}' && st->word_len == 0 && st->brace_depth > 0) {
+            st->brace_depth--;
+            st->pending_op = false;
+            p++;
+            continue;
+        }
+        if (!is_word_break(c)) {
+            word_char(st, c, isalpha((unsigned char)c));
+            st->pending_op = false;
             p++;
-            if (*p) p++;
-            last_op_pos = NULL;
             continue;
         }
 
-        if (in_sq) {
-            if (*p == '\'') in_sq = false;
-        } else if (in_dq) {
-            if (*p == '"') in_dq = false;
-        } else {
-            if (*p == '\'') { in_sq = true; last_op_pos = NULL; }
-            else if (*p == '"') { in_dq = true; last_op_pos = NULL; }
-            else if (*p == '{') brace_depth++;
-            else if (*p == '}') brace_depth--;
-            else if (strncmp(p, "<<", 2) == 0 && *(p+2) != '<' && *(p+2) != '>') {
-                const char *q = p + 2;
-                while (*q == ' ' || *q == '\t') q++;
-                if (*q == '-') { q++; while (*q == ' ' || *q == '\t') q++; }
-                bool qdel = (*q == '\'' || *q == '"');
-                char qch = qdel ? *q++ : 0;
-                char delim[64] = {0};
-                int di = 0;
-                while (*q && di < 63) {
-                    if (qdel && *q == qch) { q++; break; }
-                    if (!qdel && (*q == ' ' || *q == '\t' || *q == '\n' ||
-                        *q == ';' || *q == '|' || *q == '&' || *q == ')')) break;
-                    delim[di++] = *q++;
-                }
-                p = q;
-                while (*p && *p != '\n') p++;
-                if (*p == '\n') {
-                    p++;
-                    while (*p) {
-                        const char *sol = p;
-                        while (*p && *p != '\n') p++;
-                        size_t ll = (size_t)(p - sol);
-                        if (ll == strlen(delim) && strncmp(sol, delim, ll) == 0) {
-                            if (*p == '\n') p++;
-                            break;
-                        }
-                        if (*p == '\n') p++;
-                    }
-                }
-                last_op_pos = NULL;
-                continue;
-            } else if (strncmp(p, "&&", 2) == 0 || strncmp(p, "||", 2) == 0) {
-                last_op_pos = p;
+        end_word(st);
+        if (c == '(') {
+            st->paren_depth++;
+            st->pending_op = false;
+        } else if (c == ')') {
+            if (st->paren_depth > 0) st->paren_depth--;
+            st->pending_op = false;
+        } else if (c == '|') {
+            st->pending_op = true;
+            if (p + 1 < end && p[1] == '|') p++;
+        } else if (c == '&') {
+            // `a && b` continues, `cmd &` is a finished background job.
+            if (p + 1 < end && p[1] == '&') {
+                st->pending_op = true;
                 p++;
-            } else if (*p == '|' || *p == '&' || *p == '(') {
-                last_op_pos = p;
-            } else if (*p == ';') {
-                last_op_pos = NULL;
-            } else if (!isspace((unsigned char)*p)) {
-                last_op_pos = NULL;
+            } else {
+                st->pending_op = false;
             }
+        } else if (c == ';') {
+            st->pending_op = false;
         }
-        if (in_sq || in_dq) last_op_pos = NULL;
-        if (*p) p++;
+        p++;
     }
 
-    if (in_sq || in_dq || brace_depth > 0 || last_op_pos != NULL) return false;
+    if (!st->in_sq && !st->in_dq) end_word(st);
+    if (st->heredocs > 0) st->in_heredoc = true;
+}
 
-    Token *tokens = tokenize(line);
-    if (!tokens) return true;
+void block_state_init(BlockState *st) {
+    memset(st, 0, sizeof(*st));
+    st->word_plain = true;
+}
 
-    int if_depth = 0, case_depth = 0, loop_depth = 0;
-    for (Token *t = tokens; t && t->type != TOK_EOF; t = t->next) {
-        if (t->type == TOK_IF) if_depth++;
-        else if (t->type == TOK_FI) if_depth--;
-        else if (t->type == TOK_CASE) case_depth++;
-        else if (t->type == TOK_ESAC) case_depth--;
-        else if (t->type == TOK_FOR || t->type == TOK_WHILE || t->type == TOK_UNTIL) loop_depth++;
-        else if (t->type == TOK_DONE) loop_depth--;
+void block_state_feed(BlockState *st, const char *text, size_t len) {
+    const char *p = text;
+    const char *end = text + len;
+    while (p <= end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        feed_line(st, p, eol);
+        if (!nl) break;
+        p = nl + 1;
     }
-    free_tokens(tokens);
+}
+
+bool block_state_complete(const BlockState *st) {
+    return !st->in_sq && !st->in_dq && !st->pending_op && st->heredocs == 0 &&
+           st->brace_depth <= 0 && st->paren_depth == 0 && st->subst_depth == 0 &&
+           st->if_depth <= 0 && st->case_depth <= 0 && st->loop_depth <= 0;
+}
 
-    if (if_depth != 0 || case_depth != 0 || loop_depth != 0) return false;
-    return true;
+bool is_block_complete(const char *line) {
+    if (!line) return true;
+    BlockState st;
+    block_state_init(&st);
+    block_state_feed(&st, line, strlen(line));
+    return block_state_complete(&st);
 }
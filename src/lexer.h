@@ -7,6 +7,8 @@
 #define LEXER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
 
 typedef enum {
     TOK_STR,
@@ -33,20 +35,54 @@ typedef enum {
     TOK_UNTIL,
     TOK_DO,
     TOK_DONE,
+    TOK_ARITH,
     TOK_EOF
 } TokenType;
 
+// Tokens are slices of the source line; `start` is NULL for operators.
+// Nothing is copied until a consumer asks for its own string.
 typedef struct Token {
     TokenType type;
-    char *val;
+    const char *start;
+    int len;
     struct Token *next;
 } Token;
 
-Token *tokenize(const char *line);
-void free_tokens(Token *head);
+Token *tokenize(const char *line, Arena *arena);
 bool match(Token **token, TokenType type);
 void consume(Token **token);
-char *concat_tokens(Token *start, Token *end);
+char *concat_tokens(Arena *arena, Token *start, Token *end);
+char *token_strdup(Arena *arena, const Token *tok);
+bool is_reserved_word(const char *s);
+
+#define HEREDOC_DELIM_MAX 64
+#define HEREDOC_PENDING_MAX 4
+
+// Lexical state carried from one input line to the next, so deciding
+// whether a multi-line command is finished only looks at the new text.
+// Each call to block_state_feed() ends a line.
+typedef struct {
+    bool in_sq;
+    bool in_dq;
+    bool pending_op;
+    bool in_heredoc;
+    bool word_plain;
+    int word_len;
+    char word[6];
+    int brace_depth;
+    int paren_depth;
+    int subst_depth;
+    int if_depth;
+    int case_depth;
+    int loop_depth;
+    int heredocs;
+    bool heredoc_strip[HEREDOC_PENDING_MAX];
+    char heredoc_delim[HEREDOC_PENDING_MAX][HEREDOC_DELIM_MAX];
+} BlockState;
+
+void block_state_init(BlockState *st);
+void block_state_feed(BlockState *st, const char *text, size_t len);
+bool block_state_complete(const BlockState *st);
 bool is_block_complete(const char *line);
 
 #endif
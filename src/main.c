@@ -20,6 +20,11 @@
 #include "ast.h"
 #include "utils.h"
 #include "linenoise.h"
+#include "script.h"
+#include "cache.h"
+#include "vars.h"
+
+extern char **environ;
 
 static char *last_command = NULL;
 
@@ -46,6 +51,27 @@ static void load_profile(const char *path) {
     }
 }
 
+// True when pos lies inside a (( )) or $(( )), where << is a shift.
+static bool in_arithmetic(const char *s, const char *pos) {
+    bool inside = false;
+    int parens = 0;
+    for (const char *p = s; p < pos; p++) {
+        if (!inside) {
+            if (p[0] == '(' && p[1] == '(') {
+                inside = true;
+                parens = 0;
+                p++;
+            }
+        } else if (*p == '(') {
+            parens++;
+        } else if (*p == ')') {
+            if (parens > 0) parens--;
+            else if (p[1] == ')') { inside = false; p++; }
+        }
+    }
+    return inside;
+}
+
 static char *collect_heredocs(const char *cmd) {
     char *result = strdup(cmd);
     if (!result) return NULL;
@@ -59,6 +85,7 @@ static char *collect_heredocs(const char *cmd) {
         if (before == '<' || before == '>') { search = hd + 2; continue; }
         char after = *(hd + 2);
         if (after == '<' || after == '>') { search = hd + 2; continue; }
+        if (in_arithmetic(result, hd)) { search = hd + 2; continue; }
 
         char *p = hd + 2;
         while (*p == ' ' || *p == '\t') p++;
@@ -174,7 +201,56 @@ static char *collect_heredocs(const char *cmd) {
     return result;
 }
 
+static void run_script_command(char *cmd) {
+    if (strstr(cmd, "\\\n") != NULL) join_continuations(cmd);
+    if (strstr(cmd, "<<") != NULL) {
+        char *expanded = collect_heredocs(cmd);
+        if (expanded) {
+            process_command_line(expanded);
+            free(expanded);
+            return;
+        }
+    }
+    process_command_line(cmd);
+}
+
+static void run_cached_script(CacheImage *img) {
+    for (;;) {
+        Arena arena;
+        arena_init(&arena);
+        ASTNode *ast;
+        char *text;
+        CacheRecordKind kind = cache_next(img, &arena, &ast, &text);
+        if (kind == CACHE_AST) execute_parsed(ast);
+        else if (kind == CACHE_TEXT) run_script_command(text);
+        arena_release(&arena);
+        if (kind == CACHE_END) break;
+    }
+}
+
+// Each complete top-level command is parsed, run and released before the
+// next one is read, so memory is bounded by the longest command rather
+// than the file size.
+static int run_script(const char *path, int fd) {
+    if (script_cache_enabled) {
+        CacheImage img;
+        if (cache_open(path, fd, &img)) {
+            run_cached_script(&img);
+            cache_close(&img);
+            return 0;
+        }
+    }
+
+    ScriptReader reader;
+    if (!script_reader_init(&reader, fd)) return 1;
+    char *cmd;
+    while ((cmd = script_reader_next(&reader)) != NULL) run_script_command(cmd);
+    script_reader_free(&reader);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    vars_init(environ);
     setvbuf(stdout, NULL, _IONBF, 0);
     setvbuf(stderr, NULL, _IONBF, 0);
 
@@ -201,6 +277,20 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (argc > 1 && strcmp(argv[1], "--cache-stats") == 0) {
+        cache_print_stats();
+        return 0;
+    }
+
+    const char *cache_env = vars_get("CVX_CACHE");
+    script_cache_enabled = cache_env && *cache_env && strcmp(cache_env, "0") != 0;
+    while (argc > 1 && (strcmp(argv[1], "--cache") == 0 || strcmp(argv[1], "--no-cache") == 0)) {
+        script_cache_enabled = strcmp(argv[1], "--cache") == 0;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
     if (argc > 2 && strcmp(argv[1], "-c") == 0) {
         if (argc > 3) {
             push_param_frame(argc - 3, argv + 3);
@@ -215,7 +305,7 @@ int main(int argc, char *argv[]) {
 
     if (argc > 1 && strcmp(argv[1], "-l") == 0) {
         load_profile("/etc/profile");
-        const char *home = getenv("HOME");
+        const char *home = vars_get("HOME");
         if (home) {
             char user_profile[1024];
             snprintf(user_profile, sizeof(user_profile), "%s/.profile", home);
@@ -224,25 +314,18 @@ int main(int argc, char *argv[]) {
     }
 
     if (argc > 1 && argv[1][0] != '-') {
-        FILE *f = fopen(argv[1], "r");
-        if (!f) { perror("Cannot open file."); return 1; }
-        fseek(f, 0, SEEK_END);
-        long fsize = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        char *buffer = malloc(fsize + 1);
-        if (!buffer) { perror("malloc"); fclose(f); return 1; }
-        size_t bytes_read = fread(buffer, 1, fsize, f);
-        fclose(f);
-        buffer[bytes_read] = '\0';
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { perror("Cannot open file."); return 1; }
         push_param_frame(argc - 1, argv + 1);
-        process_command_line(buffer);
+        run_script(argv[1], fd);
         pop_param_frame();
-        free(buffer);
+        close(fd);
         return 0;
     }
 
     char *line;
-    setenv("TERM", "xterm", 1);
+    vars_export("TERM", "xterm");
+    vars_environ();
 
     setup_signals();
 
@@ -252,7 +335,7 @@ int main(int argc, char *argv[]) {
 
     const char *history_file = ".cvx_history";
     char history_path[1024];
-    const char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     if (!home) home = ".";
     snprintf(history_path, sizeof(history_path), "%s/%s", home, history_file);
     linenoiseHistoryLoad(history_path);
@@ -267,6 +350,9 @@ int main(int argc, char *argv[]) {
         const char *prompt = get_prompt();
         char *full_line = NULL;
         size_t full_len = 0;
+        size_t fed = 0;
+        BlockState block;
+        block_state_init(&block);
 
         while (1) {
             line = linenoise(full_line == NULL ? prompt : "> ");
@@ -305,7 +391,11 @@ int main(int argc, char *argv[]) {
                 full_line[full_len] = '\0';
                 free(line);
 
-                if (!is_block_complete(full_line)) {
+                // Only the newly completed line is scanned; a long paste
+                // stays linear instead of rescanning the whole buffer.
+                block_state_feed(&block, full_line + fed, full_len - fed);
+                fed = full_len;
+                if (!block_state_complete(&block)) {
                     continue;
                 }
                 break;
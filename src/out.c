@@ -0,0 +1,100 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include "out.h"
+
+#define OUT_BUF_SIZE 8192
+
+static char out_buf[OUT_BUF_SIZE];
+static size_t out_len = 0;
+
+// Errors such as EPIPE drop the rest, like a failed putchar() would.
+static void write_all(const char *s, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(STDOUT_FILENO, s, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        s += w;
+        n -= w;
+    }
+}
+
+void out_flush(void) {
+    if (out_len == 0) return;
+    write_all(out_buf, out_len);
+    out_len = 0;
+}
+
+void out_write(const char *s, size_t n) {
+    if (out_len + n > OUT_BUF_SIZE) out_flush();
+    if (n >= OUT_BUF_SIZE) {
+        write_all(s, n);
+        return;
+    }
+    memcpy(out_buf + out_len, s, n);
+    out_len += n;
+}
+
+void out_putc(int c) {
+    if (out_len == OUT_BUF_SIZE) out_flush();
+    out_buf[out_len++] = (char)c;
+}
+
+void out_puts(const char *s) {
+    out_write(s, strlen(s));
+}
+
+int out_printf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out_buf + out_len, OUT_BUF_SIZE - out_len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return n;
+    if ((size_t)n < OUT_BUF_SIZE - out_len) {
+        out_len += n;
+        return n;
+    }
+
+    // Did not fit behind what is buffered: flush and format again, into
+    // the empty buffer or, for very long output, a temporary one.
+    out_flush();
+    char *big = (size_t)n < OUT_BUF_SIZE ? out_buf : malloc(n + 1);
+    if (!big) return -1;
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    if (big == out_buf) {
+        out_len = n;
+    } else {
+        write_all(big, n);
+        free(big);
+    }
+    return n;
+}
+
+// Builtins report errors through these, so what they printed before
+// the error reaches stdout first.
+void out_error(const char *fmt, ...) {
+    out_flush();
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+void out_perror(const char *s) {
+    int saved = errno;
+    out_flush();
+    errno = saved;
+    perror(s);
+}
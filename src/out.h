@@ -0,0 +1,22 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef OUT_H
+#define OUT_H
+
+#include <stddef.h>
+
+// Builtins write their stdout through this buffer. It is flushed when it
+// fills and when the builtin returns, and before the shell starts any
+// child, so output still interleaves with child processes in order.
+void out_write(const char *s, size_t n);
+void out_putc(int c);
+void out_puts(const char *s);
+int out_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void out_flush(void);
+void out_error(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void out_perror(const char *s);
+
+#endif
@@ -11,6 +11,8 @@
 #include "lexer.h"
 #include "ast.h"
 #include "parser.h"
+#include "utils.h"
+#include "brace.h"
 
 static ASTNode *parse_command(Token **token);
 static ASTNode *parse_pipeline(Token **token);
@@ -21,6 +23,51 @@ static ASTNode *parse_case(Token **token);
 static ASTNode *parse_for(Token **token);
 static ASTNode *parse_while_until(Token **token, bool is_until);
 
+// Arena of the parse_ast() call in progress; all nodes and strings of
+// the tree are allocated from it.
+static Arena *ast_arena = NULL;
+
+static unsigned char classify_word(const char *w) {
+    unsigned char flags = WORD_LITERAL;
+    for (const char *p = w; *p; p++) {
+        if (*p == '\x10') {
+            if (p[1]) p++;
+        } else if (*p == '$') {
+            flags |= WORD_PARAM;
+            if (p[1] == '(' && p[2] != '(') flags |= WORD_CMDSUB;
+            if (p[1] == '(' && p[2] == '(') flags |= WORD_ARITH;
+        } else if (*p == '~') {
+            flags |= WORD_PARAM;
+        } else if (*p == '\x01' || *p == '\x02' || *p == '\x03') {
+            flags |= WORD_GLOB;
+        }
+    }
+    if (has_braces(w)) flags |= WORD_BRACE;
+    return flags;
+}
+
+static Word *split_words(const char *cmd, int *count) {
+    ArgVec argv;
+    argv_init(&argv);
+    int n = split_args(cmd, &argv);
+    char **args = argv.v;
+    Word *words = arena_alloc(ast_arena, (n > 0 ? n : 1) * sizeof(Word));
+    for (int i = 0; i < n; i++) {
+        words[i].flags = classify_word(args[i]);
+        if (words[i].flags == WORD_LITERAL) quote_removal(&args[i], 1);
+        words[i].text = arena_strdup(ast_arena, args[i]);
+    }
+    argv_clear(&argv);
+    *count = n;
+    return words;
+}
+
+static ASTNode *new_node(ASTNodeType type) {
+    ASTNode *node = arena_calloc(ast_arena, sizeof(ASTNode));
+    node->type = type;
+    return node;
+}
+
 static ASTNode *parse_if_inner(Token **token, bool expect_fi) {
     consume(token);
     ASTNode *cond = parse_sequence(token);
@@ -40,11 +87,10 @@ static ASTNode *parse_if_inner(Token **token, bool expect_fi) {
         fprintf(stderr, "syntax error: expected 'fi'\n");
     }
     
-    ASTNode *node = calloc(1, sizeof(*node));
-    node->type = AST_IF;
-    node->cond = cond;
-    node->left = then_branch;
-    node->right = else_branch;
+    ASTNode *node = new_node(AST_IF);
+    node->if_stmt.cond = cond;
+    node->if_stmt.then_branch = then_branch;
+    node->if_stmt.else_branch = else_branch;
     return node;
 }
 
@@ -55,38 +101,45 @@ static ASTNode *parse_if(Token **token) {
 static ASTNode *parse_case(Token **token) {
     consume(token);
     if ((*token)->type != TOK_STR) return NULL;
-    char *word = strdup((*token)->val);
+    char *word = token_strdup(ast_arena, *token);
     consume(token);
     if (!match(token, TOK_IN)) {
-        free(word);
         return NULL;
     }
-    ASTNode *root = calloc(1, sizeof(*root));
-    root->type = AST_CASE;
-    root->cmd = word;
-    ASTNode **next_item = &root->left;
+    ASTNode *root = new_node(AST_CASE);
+    root->case_stmt.word = word;
+    int cap = 0;
 
+    while ((*token)->type == TOK_SEMI) consume(token);
     while ((*token)->type != TOK_ESAC && (*token)->type != TOK_EOF) {
+        // A pattern list may be written (pattern), as POSIX allows.
+        if ((*token)->type == TOK_LPAREN) consume(token);
         Token *p_start = *token;
         while ((*token)->type != TOK_RPAREN && (*token)->type != TOK_EOF) {
             consume(token);
         }
-        char *pattern = concat_tokens(p_start, *token);
+        char *pattern = concat_tokens(ast_arena, p_start, *token);
         consume(token);
         
         ASTNode *body = parse_sequence(token);
         
-        ASTNode *item = calloc(1, sizeof(*item));
-        item->type = AST_CASE_ITEM;
-        item->cmd = pattern;
-        item->left = body;
-        *next_item = item;
-        next_item = &item->right;
+        if (root->case_stmt.narms == cap) {
+            cap = cap ? cap * 2 : 4;
+            CaseArm *arms = arena_alloc(ast_arena, cap * sizeof(CaseArm));
+            if (root->case_stmt.narms)
+                memcpy(arms, root->case_stmt.arms, root->case_stmt.narms * sizeof(CaseArm));
+            root->case_stmt.arms = arms;
+        }
+        CaseArm *arm = &root->case_stmt.arms[root->case_stmt.narms++];
+        arm->pattern = pattern;
+        arm->body = body;
         
         if ((*token)->type == TOK_DSEMI) consume(token);
         else if ((*token)->type == TOK_ESAC) break;
+        while ((*token)->type == TOK_SEMI) consume(token);
     }
     match(token, TOK_ESAC);
+    case_compile(ast_arena, root);
     return root;
 }
 
@@ -101,24 +154,88 @@ static ASTNode *parse_while_until(Token **token, bool is_until) {
     if (!match(token, TOK_DONE)) {
         fprintf(stderr, "syntax error: expected 'done'\n");
     }
-    ASTNode *node = calloc(1, sizeof(*node));
-    node->type = is_until ? AST_UNTIL : AST_WHILE;
-    node->cond = cond;
-    node->left = body;
+    ASTNode *node = new_node(is_until ? AST_UNTIL : AST_WHILE);
+    node->loop.cond = cond;
+    node->loop.body = body;
+    return node;
+}
+
+// Splits the text of for (( init; cond; step )) at its two top-level
+// semicolons. Empty parts are left NULL.
+static bool split_arith_for(ASTNode *node, const Token *tok) {
+    char *parts[3] = { NULL, NULL, NULL };
+    const char *p = tok->start, *end = tok->start + tok->len, *part = p;
+    int n = 0, depth = 0;
+    for (; p <= end; p++) {
+        if (p < end && *p == '(') depth++;
+        else if (p < end && *p == ')') depth--;
+        else if (p == end || (*p == ';' && depth == 0)) {
+            if (n == 3) return false;
+            const char *s = part;
+            while (s < p && (*s == ' ' || *s == '\t' || *s == '\n')) s++;
+            if (s < p) parts[n] = arena_strndup(ast_arena, s, p - s);
+            n++;
+            part = p + 1;
+        }
+    }
+    if (n != 3) return false;
+    node->arith_for.init = parts[0];
+    node->arith_for.cond = parts[1];
+    node->arith_for.step = parts[2];
+    return true;
+}
+
+static ASTNode *parse_arith_for(Token **token) {
+    ASTNode *node = new_node(AST_ARITH_FOR);
+    if (!split_arith_for(node, *token)) {
+        fprintf(stderr, "syntax error: expected 'for ((init; cond; step))'\n");
+        return NULL;
+    }
+    consume(token);
+    if ((*token)->type == TOK_SEMI) consume(token);
+    if (!match(token, TOK_DO)) {
+        fprintf(stderr, "syntax error: expected 'do'\n");
+        return node;
+    }
+    node->arith_for.body = parse_sequence(token);
+    if (!match(token, TOK_DONE)) {
+        fprintf(stderr, "syntax error: expected 'done'\n");
+    }
     return node;
 }
 
 static ASTNode *parse_for(Token **token) {
     consume(token);
+    if ((*token)->type == TOK_ARITH) return parse_arith_for(token);
     if ((*token)->type != TOK_STR) {
         fprintf(stderr, "syntax error: expected variable name\n");
         return NULL;
     }
-    char *var_name = strdup((*token)->val);
+    // for -j N name ...: the iterations run in parallel; see for_parallel().
+    char *jobs = NULL;
+    const Token *t = *token;
+    if (t->start && t->len >= 2 && strncmp(t->start, "-j", 2) == 0) {
+        if (t->len > 2) {
+            jobs = arena_strndup(ast_arena, t->start + 2, t->len - 2);
+        } else {
+            consume(token);
+            if ((*token)->type != TOK_STR) {
+                fprintf(stderr, "syntax error: expected job count\n");
+                return NULL;
+            }
+            jobs = token_strdup(ast_arena, *token);
+        }
+        consume(token);
+        if ((*token)->type != TOK_STR) {
+            fprintf(stderr, "syntax error: expected variable name\n");
+            return NULL;
+        }
+    }
+    char *var_name = token_strdup(ast_arena, *token);
     consume(token);
-    ASTNode *node = calloc(1, sizeof(*node));
-    node->type = AST_FOR;
-    node->name = var_name;
+    ASTNode *node = new_node(AST_FOR);
+    node->for_loop.var = var_name;
+    node->for_loop.jobs = jobs;
 
     if ((*token)->type == TOK_IN) {
         consume(token);
@@ -126,20 +243,20 @@ static ASTNode *parse_for(Token **token) {
         while ((*token)->type != TOK_SEMI && (*token)->type != TOK_EOF && (*token)->type != TOK_DO) {
             consume(token);
         }
-        node->cmd = concat_tokens(start, *token);
+        node->for_loop.list = concat_tokens(ast_arena, start, *token);
         if ((*token)->type == TOK_SEMI) consume(token);
     } else if ((*token)->type == TOK_SEMI) {
         consume(token);
-        node->cmd = strdup("\"$@\"");
+        node->for_loop.list = arena_strdup(ast_arena, "\"$@\"");
     } else {
-        node->cmd = strdup("\"$@\"");
+        node->for_loop.list = arena_strdup(ast_arena, "\"$@\"");
     }
 
     if (!match(token, TOK_DO)) {
         fprintf(stderr, "syntax error: expected 'do'\n");
         return node;
     }
-    node->left = parse_sequence(token);
+    node->for_loop.body = parse_sequence(token);
     if (!match(token, TOK_DONE)) {
         fprintf(stderr, "syntax error: expected 'done'\n");
     }
@@ -152,6 +269,12 @@ static ASTNode *parse_command(Token **token) {
     if ((*token)->type == TOK_WHILE) return parse_while_until(token, false);
     if ((*token)->type == TOK_UNTIL) return parse_while_until(token, true);
     if ((*token)->type == TOK_FOR) return parse_for(token);
+    if ((*token)->type == TOK_ARITH) {
+        ASTNode *node = new_node(AST_ARITH);
+        node->arith.expr = token_strdup(ast_arena, *token);
+        consume(token);
+        return node;
+    }
 
     if ((*token)->type == TOK_LPAREN) {
         consume(token);
@@ -160,10 +283,9 @@ static ASTNode *parse_command(Token **token) {
             fprintf(stderr, "cvx_shell: syntax error: expected ')'\n");
             return NULL;
         }
-        ASTNode *node = calloc(1, sizeof(*node));
+        ASTNode *node = new_node(AST_SUBSHELL);
         if (!node) return NULL;
-        node->type = AST_SUBSHELL;
-        node->left = inner;
+        node->unary.body = inner;
         return node;
     }
     
@@ -171,13 +293,12 @@ static ASTNode *parse_command(Token **token) {
         (*token)->next && (*token)->next->type == TOK_LPAREN &&
         (*token)->next->next && (*token)->next->next->type == TOK_RPAREN &&
         (*token)->next->next->next && (*token)->next->next->next->type == TOK_BLOCK) {
-        char *name = strdup((*token)->val);
-        char *body = strdup((*token)->next->next->next->val);
+        char *name = token_strdup(ast_arena, *token);
+        char *body = token_strdup(ast_arena, (*token)->next->next->next);
         for (int i = 0; i < 4; i++) consume(token);
-        ASTNode *node = calloc(1, sizeof(*node));
-        node->type = AST_FUNCDEF;
-        node->name = name;
-        node->cmd = body; 
+        ASTNode *node = new_node(AST_FUNCDEF);
+        node->funcdef.name = name;
+        node->funcdef.body = body; 
         return node;
     }
     if ((*token)->type == TOK_STR) {
@@ -200,11 +321,11 @@ static ASTNode *parse_command(Token **token) {
             }
             end = end->next;
         }
-        char *cmd_str = concat_tokens(start, end);
+        char *cmd_str = concat_tokens(ast_arena, start, end);
         *token = end;
-        ASTNode *node = calloc(1, sizeof(*node));
-        node->type = AST_COMMAND;
-        node->cmd = cmd_str;
+        ASTNode *node = new_node(AST_COMMAND);
+        node->command.text = cmd_str;
+        node->command.words = split_words(cmd_str, &node->command.nwords);
         return node;
     }
     return NULL;
@@ -223,16 +344,14 @@ static ASTNode *parse_pipeline(Token **token) {
         while ((*token)->type == TOK_SEMI) consume(token);
         ASTNode *right = parse_command(token);
         if (!right) break;
-        ASTNode *node = calloc(1, sizeof(*node));
-        node->type = AST_PIPELINE;
-        node->left = left;
-        node->right = right;
+        ASTNode *node = new_node(AST_PIPELINE);
+        node->binary.left = left;
+        node->binary.right = right;
         left = node;
     }
     if (negate) {
-        ASTNode *neg = calloc(1, sizeof(*neg));
-        neg->type = AST_NEGATION;
-        neg->left = left;
+        ASTNode *neg = new_node(AST_NEGATION);
+        neg->unary.body = left;
         left = neg;
     }
     return left;
@@ -247,105 +366,149 @@ static ASTNode *parse_and_or(Token **token) {
         while ((*token)->type == TOK_SEMI) consume(token);
         ASTNode *right = parse_pipeline(token);
         if (!right) break;
-        ASTNode *node = calloc(1, sizeof(*node));
-        node->type = (op == TOK_AND) ? AST_AND : AST_OR;
-        node->left = left;
-        node->right = right;
+        ASTNode *node = new_node((op == TOK_AND) ? AST_AND : AST_OR);
+        node->binary.left = left;
+        node->binary.right = right;
         left = node; 
     }
     return left;
 }
 
+static bool ends_sequence(TokenType type) {
+    return type == TOK_EOF || type == TOK_RPAREN ||
+           type == TOK_THEN || type == TOK_ELIF ||
+           type == TOK_ELSE || type == TOK_FI ||
+           type == TOK_ESAC || type == TOK_DSEMI ||
+           type == TOK_DO || type == TOK_DONE;
+}
+
+// Builds the right-nested chain of AST_SEQUENCE nodes in a loop rather
+// than by recursion, so long generated scripts cannot exhaust the stack.
 static ASTNode *parse_sequence(Token **token) {
-    while ((*token)->type == TOK_SEMI) {
-        consume(token);
-    }
-    
-    ASTNode *left = parse_and_or(token);
-    if (!left) {
-        if ((*token)->type != TOK_EOF && (*token)->type != TOK_RPAREN &&
-            (*token)->type != TOK_THEN && (*token)->type != TOK_ELIF &&
-            (*token)->type != TOK_ELSE && (*token)->type != TOK_FI &&
-            (*token)->type != TOK_ESAC && (*token)->type != TOK_DSEMI &&
-            (*token)->type != TOK_DO && (*token)->type != TOK_DONE) {
-             consume(token);
-             return parse_sequence(token);
+    ASTNode *head = NULL;
+    ASTNode **slot = &head;
+    ASTNode **pending = NULL;
+
+    for (;;) {
+        while ((*token)->type == TOK_SEMI) {
+            consume(token);
         }
-        return NULL;
-    }
-    
-    bool is_sequence = false;
-    
-    while ((*token)->type == TOK_AMP || (*token)->type == TOK_SEMI) {
-        bool is_bg = ((*token)->type == TOK_AMP);
-        consume(token);
         
-        if (is_bg) {
-            ASTNode *bg = calloc(1, sizeof(*bg));
-            bg->type = AST_BACKGROUND;
-            bg->left = left;
-            left = bg;
+        ASTNode *left = parse_and_or(token);
+        if (!left) {
+            if (!ends_sequence((*token)->type)) {
+                 consume(token);
+                 continue;
+            }
+            break;
         }
         
-        is_sequence = true;
-    }
-    
-    if (!is_sequence && (*token)->type != TOK_EOF && (*token)->type != TOK_PIPE && 
-        (*token)->type != TOK_AND && (*token)->type != TOK_OR && (*token)->type != TOK_RPAREN &&
-        (*token)->type != TOK_THEN && (*token)->type != TOK_ELIF && (*token)->type != TOK_ELSE &&
-        (*token)->type != TOK_FI && (*token)->type != TOK_ESAC && (*token)->type != TOK_DSEMI &&
-        (*token)->type != TOK_DO && (*token)->type != TOK_DONE) {
-        is_sequence = true;
-    }
-
-    if (is_sequence) {
-        if ((*token)->type != TOK_EOF && (*token)->type != TOK_RPAREN &&
-            (*token)->type != TOK_THEN && (*token)->type != TOK_ELIF &&
-            (*token)->type != TOK_ELSE && (*token)->type != TOK_FI &&
-            (*token)->type != TOK_ESAC && (*token)->type != TOK_DSEMI &&
-            (*token)->type != TOK_DO && (*token)->type != TOK_DONE) {
-            ASTNode *right = parse_sequence(token);
-            if (right) {
-                ASTNode *seq = calloc(1, sizeof(*seq));
-                seq->type = AST_SEQUENCE;
-                seq->left = left;
-                seq->right = right;
-                left = seq;
+        bool is_sequence = false;
+        
+        while ((*token)->type == TOK_AMP || (*token)->type == TOK_SEMI) {
+            bool is_bg = ((*token)->type == TOK_AMP);
+            consume(token);
+            
+            if (is_bg) {
+                ASTNode *bg = new_node(AST_BACKGROUND);
+                bg->unary.body = left;
+                left = bg;
             }
+            
+            is_sequence = true;
+        }
+        
+        if (!is_sequence && !ends_sequence((*token)->type) && (*token)->type != TOK_PIPE && 
+            (*token)->type != TOK_AND && (*token)->type != TOK_OR) {
+            is_sequence = true;
+        }
+
+        if (is_sequence && !ends_sequence((*token)->type)) {
+            ASTNode *seq = new_node(AST_SEQUENCE);
+            seq->binary.left = left;
+            *slot = seq;
+            pending = slot;
+            slot = &seq->binary.right;
+            continue;
         }
+
+        *slot = left;
+        return head;
     }
-    
-    return left;
+
+    // The last command turned out to have nothing after it.
+    if (pending) *pending = (*pending)->binary.left;
+    return head;
 }
 
-ASTNode* parse_ast(const char *line) {
-    Token *tokens = tokenize(line);
-    if (!tokens) return NULL;
-    
+static ASTNode *parse_tokens(const char *line, Arena *arena, bool report, bool *error) {
+    Arena tokens_arena;
+    arena_init(&tokens_arena);
+    Token *tokens = tokenize(line, &tokens_arena);
+    if (error) *error = false;
+    if (!tokens) {
+        arena_release(&tokens_arena);
+        return NULL;
+    }
+
+    Arena *saved_arena = ast_arena;
+    ast_arena = arena;
     Token *ptr = tokens;
     ASTNode *ast = parse_sequence(&ptr);
+    ast_arena = saved_arena;
     
     if (ptr && ptr->type != TOK_EOF) {
-        fprintf(stderr, "cvx_shell: syntax error near '%s'\n", ptr->val ? ptr->val : "EOF");
-        free_ast(ast);
-        free_tokens(tokens);
-        return NULL;
+        if (!report) {
+            if (error) *error = true;
+        } else if (ptr->start) {
+            fprintf(stderr, "cvx_shell: syntax error near '%.*s'\n", ptr->len, ptr->start);
+        } else {
+            fprintf(stderr, "cvx_shell: syntax error near 'EOF'\n");
+        }
+        ast = NULL;
     }
     
-    free_tokens(tokens);
+    arena_release(&tokens_arena);
     return ast;
 }
 
+ASTNode* parse_ast(const char *line, Arena *arena) {
+    return parse_tokens(line, arena, true, NULL);
+}
+
+// Like parse_ast() but reports a syntax error through *error instead of
+// printing it, for callers that parse ahead of running.
+ASTNode *parse_ast_silent(const char *line, Arena *arena, bool *error) {
+    return parse_tokens(line, arena, false, error);
+}
+
 #include "exec.h"
+#include "vm.h"
+
+int execute_parsed(ASTNode *ast) {
+    sigint_received = 0;
+    loop_control = 0;
+    if (opt_treewalk) return execute_ast(ast, false);
+
+    Program *prog = vm_compile(ast);
+    int status = vm_run(prog);
+    vm_free(prog);
+    return status;
+}
 
 int process_command_line(char *line) {
     if (!line || !*line) return 0;
     
     sigint_received = 0;
     loop_control = 0;
-    ASTNode *ast = parse_ast(line);
-    if (!ast) return 0;
-    int status = execute_ast(ast, false);
-    free_ast(ast);
+    Arena arena;
+    arena_init(&arena);
+    ASTNode *ast = parse_ast(line, &arena);
+    if (!ast) {
+        arena_release(&arena);
+        return 0;
+    }
+    int status = execute_parsed(ast);
+    arena_release(&arena);
     return status;
 }
@@ -7,8 +7,11 @@
 #define PARSER_H
 
 #include "ast.h"
+#include "arena.h"
 
-ASTNode* parse_ast(const char *line);
+ASTNode* parse_ast(const char *line, Arena *arena);
+ASTNode *parse_ast_silent(const char *line, Arena *arena, bool *error);
+int execute_parsed(ASTNode *ast);
 int process_command_line(char *line);
 
 #endif
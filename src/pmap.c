@@ -0,0 +1,204 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include "commands.h"
+#include "exec.h"
+#include "jobs.h"
+#include "out.h"
+#include "utils.h"
+
+#define PMAP_READ_SIZE 65536
+
+typedef struct {
+    char **tmpl;
+    int ntmpl;
+    bool has_slot;
+    JobPool *pool;
+} PmapRun;
+
+// Reads delimited records from a fd, one at a time.
+typedef struct {
+    int fd;
+    char delim;
+    char *buf;
+    size_t start, len, cap;
+    bool eof;
+} RecordReader;
+
+// Returns the next non-empty record, NUL-terminated in the reader's
+// buffer and valid until the next call, or NULL at end of input.
+static char *next_record(RecordReader *r) {
+    for (;;) {
+        char *d = r->start < r->len ? memchr(r->buf + r->start, r->delim, r->len - r->start) : NULL;
+        if (d || (r->eof && r->start < r->len)) {
+            char *rec = r->buf + r->start;
+            size_t n = d ? (size_t)(d - rec) : r->len - r->start;
+            rec[n] = '\0';
+            r->start += n + (d ? 1 : 0);
+            if (n == 0) continue;
+            return rec;
+        }
+        if (r->eof) return NULL;
+        if (r->start > 0) {
+            memmove(r->buf, r->buf + r->start, r->len - r->start);
+            r->len -= r->start;
+            r->start = 0;
+        }
+        if (r->cap - r->len < PMAP_READ_SIZE / 2) {
+            size_t cap = r->cap ? r->cap * 2 : PMAP_READ_SIZE;
+            char *buf = realloc(r->buf, cap + 1);
+            if (!buf) return NULL;
+            r->buf = buf;
+            r->cap = cap;
+        }
+        ssize_t n = read(r->fd, r->buf + r->len, r->cap - r->len);
+        if (n < 0 && errno == EINTR && !sigint_received) continue;
+        if (n <= 0) r->eof = true;
+        else r->len += n;
+    }
+}
+
+// Fills {} in the command with the records of one batch: a {} word
+// becomes one word per record, a {} inside a word the records joined by
+// spaces. Without any {} the records are appended.
+static void build_task(const PmapRun *run, char **recs, int nrecs, ArgVec *out) {
+    for (int i = 0; i < run->ntmpl; i++) {
+        const char *w = run->tmpl[i];
+        if (strcmp(w, "{}") == 0) {
+            for (int k = 0; k < nrecs; k++) argv_push(out, strdup(recs[k]));
+            continue;
+        }
+        const char *slot = strstr(w, "{}");
+        if (!slot) {
+            argv_push(out, strdup(w));
+            continue;
+        }
+        size_t len = strlen(w);
+        for (int k = 0; k < nrecs; k++) len += strlen(recs[k]) + 1;
+        char *s = malloc(len + 1), *p = s;
+        if (!s) continue;
+        for (const char *q = w; *q;) {
+            if (q[0] == '{' && q[1] == '}') {
+                for (int k = 0; k < nrecs; k++) {
+                    if (k) *p++ = ' ';
+                    size_t n = strlen(recs[k]);
+                    memcpy(p, recs[k], n);
+                    p += n;
+                }
+                q += 2;
+            } else {
+                *p++ = *q++;
+            }
+        }
+        *p = '\0';
+        argv_push(out, s);
+    }
+    if (!run->has_slot)
+        for (int k = 0; k < nrecs; k++) argv_push(out, strdup(recs[k]));
+}
+
+static bool start_task(PmapRun *run, char **recs, int nrecs) {
+    int out_fd, err_fd;
+    if (!pool_next(run->pool, &out_fd, &err_fd)) return false;
+    ArgVec args;
+    argv_init(&args);
+    build_task(run, recs, nrecs, &args);
+    pool_started(run->pool, spawn_task(args.v, args.n, run->pool, out_fd, err_fd));
+    argv_clear(&args);
+    return true;
+}
+
+// Parses the -n batch size: any positive int.
+static int parse_batch(const char *arg) {
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (!*arg || *end || errno || n < 1 || n > INT_MAX) return -1;
+    return (int)n;
+}
+
+static int pmap_usage(void) {
+    out_error("cvx: pmap: usage: pmap [-j N] [-n N] [-0 | -d C] [-u] [-e] command [args...]\n");
+    return 2;
+}
+
+// pmap [-j N] [-n N] [-0 | -d C] [-u] [-e] command [args...]
+// Runs command once per record of stdin, or per N records with -n, on up
+// to N children at a time (-j, default one per CPU). Records end at a
+// newline, a NUL with -0, or the char C; empty ones are skipped. Each
+// run's output is written whole, in input order, or as runs end with -u.
+// -e stops at the first failure. The status is that of the first failing
+// run.
+int cmd_pmap(int argc, char **argv) {
+    int jobs = pool_size("0"), batch = 1, flags = POOL_CAPTURE | POOL_ORDERED;
+    char delim = '\n';
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(opt, "-0") == 0) {
+            delim = '\0';
+        } else if (strcmp(opt, "-u") == 0) {
+            flags &= ~POOL_ORDERED;
+        } else if (strcmp(opt, "-e") == 0) {
+            flags |= POOL_FAIL_FAST;
+        } else if (opt[1] == 'j' || opt[1] == 'n' || opt[1] == 'd') {
+            const char *val = opt[2] ? opt + 2 : (i + 1 < argc ? argv[++i] : NULL);
+            if (!val) return pmap_usage();
+            if (opt[1] == 'd') {
+                if (strcmp(val, "\\n") == 0) delim = '\n';
+                else if (strcmp(val, "\\t") == 0) delim = '\t';
+                else if (strcmp(val, "\\0") == 0) delim = '\0';
+                else if (strlen(val) == 1) delim = val[0];
+                else return pmap_usage();
+            } else {
+                int n = opt[1] == 'j' ? pool_size(val) : parse_batch(val);
+                if (n < 0) {
+                    out_error("cvx: pmap: %s: invalid count\n", val);
+                    return 2;
+                }
+                if (opt[1] == 'j') jobs = n;
+                else batch = n;
+            }
+        } else {
+            return pmap_usage();
+        }
+    }
+    if (i >= argc) return pmap_usage();
+
+    PmapRun run = { .tmpl = argv + i, .ntmpl = argc - i };
+    for (int k = 0; k < run.ntmpl; k++)
+        if (strstr(run.tmpl[k], "{}")) run.has_slot = true;
+    run.pool = pool_new(jobs, flags);
+    if (!run.pool) return 1;
+
+    // Records of the batch being filled are copied out of the reader,
+    // whose buffer moves as it reads.
+    RecordReader reader = { .fd = STDIN_FILENO, .delim = delim };
+    ArgVec recs;
+    argv_init(&recs);
+    bool running = true;
+    char *rec;
+    while (running && !sigint_received && (rec = next_record(&reader)) != NULL) {
+        argv_push(&recs, strdup(rec));
+        if (recs.n < batch) continue;
+        running = start_task(&run, recs.v, recs.n);
+        argv_clear(&recs);
+    }
+    if (running && recs.n > 0 && !sigint_received) start_task(&run, recs.v, recs.n);
+    argv_clear(&recs);
+    free(reader.buf);
+    return pool_finish(run.pool);
+}
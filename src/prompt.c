@@ -11,6 +11,7 @@
 #include <pwd.h>
 #include <ctype.h>
 #include "prompt.h"
+#include "vars.h"
 
 static void expand_escapes(const char *src, char *dest, size_t dest_size) {
     size_t j = 0;
@@ -62,7 +63,7 @@ const char* get_prompt(void) {
         struct passwd *pw = getpwuid(getuid());
         const char *username = pw ? pw->pw_name : "unknown";
         gethostname(hostname, sizeof(hostname));
-        strncpy(home, getenv("HOME") ? getenv("HOME") : "", sizeof(home));
+        strncpy(home, vars_get("HOME") ? vars_get("HOME") : "", sizeof(home));
         home[sizeof(home)-1] = '\0';
 
         if (strncmp(current_dir, home, strlen(home)) == 0) {
@@ -84,7 +85,7 @@ const char* get_prompt(void) {
     while (*p) {
         if (*p == '$') {
             if (strncmp(p, "$USER", 5) == 0) {
-                strncat(buf, getenv("USER") ? getenv("USER") : "", sizeof(buf)-strlen(buf)-1);
+                strncat(buf, vars_get("USER") ? vars_get("USER") : "", sizeof(buf)-strlen(buf)-1);
                 p += 5;
                 continue;
             } else if (strncmp(p, "$HOST", 5) == 0) {
@@ -96,7 +97,7 @@ const char* get_prompt(void) {
             } else if (strncmp(p, "$PWD", 4) == 0) {
                 char pwd[1024];
                 getcwd(pwd, sizeof(pwd));
-                const char *home = getenv("HOME");
+                const char *home = vars_get("HOME");
                 if (home && strncmp(pwd, home, strlen(home)) == 0) {
                     char tmp2[1024];
                     snprintf(tmp2, sizeof(tmp2), "~%s", pwd + strlen(home));
@@ -116,7 +117,7 @@ const char* get_prompt(void) {
                     p++;
                 }
                 varname[i] = '\0';
-                const char *val = getenv(varname);
+                const char *val = vars_get(varname);
                 if (val) strncat(buf, val, sizeof(buf)-strlen(buf)-1);
                 continue;
             }
@@ -0,0 +1,87 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "script.h"
+
+#define SCRIPT_CHUNK 65536
+
+bool script_reader_init(ScriptReader *r, int fd) {
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->cap = SCRIPT_CHUNK;
+    r->buf = malloc(r->cap + 1);
+    if (!r->buf) { perror("malloc"); return false; }
+    block_state_init(&r->block);
+    return true;
+}
+
+void script_reader_free(ScriptReader *r) {
+    free(r->buf);
+    r->buf = NULL;
+}
+
+// Returns the next complete top-level command, NUL terminated, or NULL at
+// the end of the script. The string stays valid until the next call.
+char *script_reader_next(ScriptReader *r) {
+    while (r->buf) {
+        char *nl = memchr(r->buf + r->scan, '\n', r->len - r->scan);
+        if (!nl && !r->eof) {
+            if (r->start > 0) {
+                memmove(r->buf, r->buf + r->start, r->len - r->start);
+                r->len -= r->start;
+                r->scan -= r->start;
+                r->start = 0;
+            }
+            if (r->len == r->cap) {
+                char *grown = realloc(r->buf, r->cap * 2 + 1);
+                if (!grown) { perror("realloc"); return NULL; }
+                r->buf = grown;
+                r->cap *= 2;
+            }
+            ssize_t n = read(r->fd, r->buf + r->len, r->cap - r->len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("read");
+                return NULL;
+            }
+            if (n == 0) r->eof = true;
+            r->len += (size_t)n;
+            continue;
+        }
+
+        size_t eol = nl ? (size_t)(nl - r->buf) : r->len;
+        block_state_feed(&r->block, r->buf + r->scan, eol - r->scan);
+        r->scan = nl ? eol + 1 : r->len;
+
+        if (nl && !block_state_complete(&r->block)) continue;
+
+        size_t start = r->start;
+        r->start = r->scan;
+        block_state_init(&r->block);
+        if (eol > start) {
+            r->buf[eol] = '\0';
+            return r->buf + start;
+        }
+        if (!nl) return NULL;
+    }
+    return NULL;
+}
+
+// Drops backslash-newline pairs the way the interactive reader joins
+// continued lines.
+void join_continuations(char *cmd) {
+    char *r = cmd, *w = cmd;
+    while (*r) {
+        if (r[0] == '\\' && r[1] == '\n') { r += 2; continue; }
+        if (r[0] == '\\' && r[1]) *w++ = *r++;
+        *w++ = *r++;
+    }
+    *w = '\0';
+}
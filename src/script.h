@@ -0,0 +1,32 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lexer.h"
+
+// Reads a script through a refillable buffer and hands out one complete
+// top-level command at a time. The buffer only grows for a command that
+// does not fit in it.
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t len;
+    size_t start;
+    size_t scan;
+    bool eof;
+    BlockState block;
+} ScriptReader;
+
+bool script_reader_init(ScriptReader *r, int fd);
+char *script_reader_next(ScriptReader *r);
+void script_reader_free(ScriptReader *r);
+void join_continuations(char *cmd);
+
+#endif
@@ -8,77 +8,61 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdbool.h>
-#include <glob.h>
 #include "utils.h"
+#include "fileglob.h"
 #include "config.h"
 #include "commands.h"
 #include "signals.h"
 #include "functions.h"
 #include "parser.h"
+#include "exec.h"
+#include "vars.h"
+#include "out.h"
+#include "arith.h"
 #include <sys/wait.h>
 
-static long get_val(const char **p) {
-    while (**p && isspace((unsigned char)**p)) (*p)++;
-    if (isdigit((unsigned char)**p)) {
-        char *endptr;
-        long val = strtol(*p, &endptr, 10);
-        *p = endptr;
-        return val;
-    } else if (isalpha((unsigned char)**p) || **p == '_') {
-        char var[128];
-        int k = 0;
-        while ((isalnum((unsigned char)**p) || **p == '_') && k < 127) var[k++] = *(*p)++;
-        var[k] = '\0';
-        char *ev = getenv(var);
-        return ev ? atol(ev) : 0;
-    }
-    return 0;
-}
-
-static long evaluate_arithmetic(const char *expr) {
-    if (!expr) return 0;
-    const char *p = expr;
-    long res = get_val(&p);
-    while (*p) {
-        while (*p && isspace((unsigned char)*p)) p++;
-        if (!*p) break;
-        char op = *p++;
-        long next = get_val(&p);
-        if (op == '+') res += next;
-        else if (op == '-') res -= next;
-        else if (op == '*') res *= next;
-        else if (op == '/' && next != 0) res /= next;
-    }
-    return res;
+// Names are read by the evaluator; only $ and ` forms in the expression
+// need expanding first.
+bool evaluate_arithmetic(const char *expr, long *result) {
+    if (!strpbrk(expr, "$`")) return arith_eval(expr, result);
+    char *expanded = expand_variables(expr);
+    bool ok = expanded && arith_eval(expanded, result);
+    free(expanded);
+    return ok;
 }
 
 char* expand_tilde(const char *path) {
     if (!path || strchr(path, '~') == NULL)
         return path ? strdup(path) : NULL;
 
-    const char *home = getenv("HOME");
+    const char *home = vars_get("HOME");
     if (!home) home = "/";
 
-    char expanded[8192] = "";
+    size_t hlen = strlen(home), count = 0;
+    for (const char *p = path; *p; p++)
+        if (*p == '~' && (p == path || p[-1] == ':')) count++;
+    char *expanded = malloc(strlen(path) + count * hlen + 1);
+    if (!expanded) return NULL;
+    char *out = expanded;
     const char *p = path;
-    
+
     while (*p) {
         if (*p == '~' && (p == path || *(p-1) == ':')) {
-            strncat(expanded, home, sizeof(expanded) - strlen(expanded) - 1);
+            memcpy(out, home, hlen);
+            out += hlen;
             p++;
         } else {
-            int len = strlen(expanded);
-            if (len < 8191) {
-                expanded[len] = *p;
-                expanded[len+1] = '\0';
-            }
-            p++;
+            *out++ = *p++;
         }
     }
-    return strdup(expanded);
+    *out = '\0';
+    return expanded;
 }
 
 char* unescape_string(const char *s) {
@@ -116,10 +100,67 @@ char* unescape_string(const char *s) {
     return buf;
 }
 
-int split_args(const char *line, char *args[], int max_args) {
-    int argc = 0;
+void argv_init(ArgVec *a) {
+    a->v = a->inline_v;
+    a->n = 0;
+    a->cap = ARGV_INLINE;
+    a->v[0] = NULL;
+}
+
+// Takes ownership of s.
+void argv_push(ArgVec *a, char *s) {
+    if (!s) return;
+    if (a->n + 1 >= a->cap) {
+        int cap = a->cap * 2;
+        char **v = a->v == a->inline_v ? malloc(cap * sizeof(char *))
+                                       : realloc(a->v, cap * sizeof(char *));
+        if (!v) {
+            free(s);
+            return;
+        }
+        if (a->v == a->inline_v) memcpy(v, a->inline_v, a->n * sizeof(char *));
+        a->v = v;
+        a->cap = cap;
+    }
+    a->v[a->n++] = s;
+    a->v[a->n] = NULL;
+}
+
+// Frees the vector but not the strings, for when free_args() or the
+// command that ran has already taken care of them.
+void argv_release(ArgVec *a) {
+    if (a->v != a->inline_v) free(a->v);
+    argv_init(a);
+}
+
+void argv_clear(ArgVec *a) {
+    free_args(a->v, a->n);
+    argv_release(a);
+}
+
+// Hands the strings over in a heap array that outlives the vector.
+char **argv_detach(ArgVec *a, int *count) {
+    char **v = a->v;
+    if (v == a->inline_v) {
+        v = malloc((a->n + 1) * sizeof(char *));
+        if (!v) {
+            argv_clear(a);
+            *count = 0;
+            return NULL;
+        }
+        memcpy(v, a->inline_v, (a->n + 1) * sizeof(char *));
+    }
+    *count = a->n;
+    argv_init(a);
+    return v;
+}
+
+// Appends the words of line to args. A word is never longer than the
+// text it came from, so one buffer of that size holds any of them.
+int split_args(const char *line, ArgVec *args) {
     const char *p = line;
-    char buffer[4096];
+    char *buffer = malloc(strlen(line) + 1);
+    if (!buffer) return args->n;
     int buf_i = 0;
     bool in_sq = false;
     bool in_dq = false;
@@ -132,7 +173,7 @@ int split_args(const char *line, char *args[], int max_args) {
             if (isspace((unsigned char)*p) || *p == '\x11') {
                 if (buf_i > 0) {
                     buffer[buf_i] = '\0';
-                    args[argc++] = strdup(buffer);
+                    argv_push(args, strdup(buffer));
                     buf_i = 0;
                 }
                 while (*p && (isspace((unsigned char)*p) || *p == '\x11')) p++;
@@ -142,7 +183,7 @@ int split_args(const char *line, char *args[], int max_args) {
             if (*p == ';' || *p == '|' || *p == '&' || *p == '(' || *p == ')') {
                 if (buf_i > 0) {
                     buffer[buf_i] = '\0';
-                    args[argc++] = strdup(buffer);
+                    argv_push(args, strdup(buffer));
                     buf_i = 0;
                 }
                 
@@ -154,14 +195,12 @@ int split_args(const char *line, char *args[], int max_args) {
                     op[1] = p[1];
                     p++;
                 }
-                args[argc++] = strdup(op);
+                argv_push(args, strdup(op));
                 p++;
                 continue;
             }
         }
 
-        if (argc >= max_args - 1) break;
-
         
         if (!in_sq) {
             if (*p == '$' && p[1] == '(') {
@@ -202,7 +241,7 @@ int split_args(const char *line, char *args[], int max_args) {
             if (*p == '<' || *p == '>' || fd_prefix != -1) {
                 if (buf_i > 0) {
                     buffer[buf_i] = '\0';
-                    args[argc++] = strdup(buffer);
+                    argv_push(args, strdup(buffer));
                     buf_i = 0;
                 }
                 char op_buf[16];
@@ -213,7 +252,7 @@ int split_args(const char *line, char *args[], int max_args) {
                     op_buf[op_j++] = *p++;
                 }
                 op_buf[op_j] = '\0';
-                args[argc++] = strdup(op_buf);
+                argv_push(args, strdup(op_buf));
                 continue;
             }
         }
@@ -272,10 +311,10 @@ int split_args(const char *line, char *args[], int max_args) {
 
     if (buf_i > 0) {
         buffer[buf_i] = '\0';
-        args[argc++] = strdup(buffer);
+        argv_push(args, strdup(buffer));
     }
-    args[argc] = NULL;
-    return argc;
+    free(buffer);
+    return args->n;
 }
 
 void free_args(char *args[], int argc) {
@@ -370,31 +409,27 @@ void handle_redirection(char *args[], int *argc) {
     }
 }
 
-void replace_alias(char *args[], int *argc) {
-    if (!args[0]) return;
+void replace_alias(ArgVec *args) {
+    if (args->n == 0) return;
 
     for (int i = 0; i < alias_count; i++) {
-        if (strcmp(args[0], aliases[i].name) == 0) {
+        if (strcmp(args->v[0], aliases[i].name) == 0) {
             char *buf = strdup(aliases[i].command);
             char *tok;
-            int new_argc = 0;
-            char *tmp_args[64];
+            ArgVec out;
+            argv_init(&out);
 
             tok = strtok(buf, " ");
-            while (tok && new_argc < 63) {
-                tmp_args[new_argc++] = strdup(tok);
+            while (tok) {
+                argv_push(&out, strdup(tok));
                 tok = strtok(NULL, " ");
             }
 
-            for (int j = 1; j < *argc && new_argc < 64; j++)
-                tmp_args[new_argc++] = strdup(args[j]);
-
-            tmp_args[new_argc] = NULL;
-
-            for (int j = 0; j < *argc; j++) free(args[j]);
-            for (int j = 0; j < new_argc; j++) args[j] = tmp_args[j];
-            args[new_argc] = NULL;
-            *argc = new_argc;
+            free(args->v[0]);
+            for (int j = 1; j < args->n; j++) argv_push(&out, args->v[j]);
+            argv_release(args);
+            for (int j = 0; j < out.n; j++) argv_push(args, out.v[j]);
+            argv_release(&out);
 
             free(buf);
             break;
@@ -464,6 +499,104 @@ static void add_c(ExpandCtx *ctx, char c) {
     (*(ctx->res))[(*(ctx->j))++] = c;
 }
 
+// $(...) output is read straight into the expansion buffer, at least
+// this much at a time.
+#define CAPTURE_CHUNK 65536
+#define CAPTURE_PIPE_SIZE (1 << 20)
+#define CAPTURE_MAX_DEFAULT ((size_t)256 << 20)
+
+// Largest output one command substitution may produce, from
+// $CVX_CAPTURE_MAX: a byte count with an optional k, m or g suffix, or 0
+// for no limit.
+static size_t capture_limit(void) {
+    const char *s = vars_get("CVX_CAPTURE_MAX");
+    if (!s || !*s) return CAPTURE_MAX_DEFAULT;
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s) return CAPTURE_MAX_DEFAULT;
+    const char *units = "kmg";
+    const char *u = *end ? strchr(units, tolower((unsigned char)*end)) : NULL;
+    if (u) n <<= 10 * (u - units + 1);
+    return n ? (size_t)n : SIZE_MAX;
+}
+
+// Appends what fd yields until EOF to the expansion buffer. Returns false
+// when the output grows past limit.
+static bool read_capture(ExpandCtx *ctx, int fd, size_t limit) {
+    size_t got = 0;
+    for (;;) {
+        if (*ctx->res_size - *ctx->j < CAPTURE_CHUNK) {
+            size_t size = *ctx->res_size * 2;
+            while (size - *ctx->j < CAPTURE_CHUNK) size *= 2;
+            char *nr = realloc(*ctx->res, size);
+            if (!nr) return true;
+            *ctx->res = nr;
+            *ctx->res_size = size;
+        }
+        size_t room = *ctx->res_size - *ctx->j - 1;
+        if (limit - got < room) room = limit - got + 1;
+        ssize_t n = read(fd, *ctx->res + *ctx->j, room);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return true;
+        *ctx->j += n;
+        got += n;
+        if (got > limit) return false;
+    }
+}
+
+// Runs a $(...) and leaves its output at the end of the expansion buffer,
+// without trailing newlines, with NUL bytes dropped and, when split is
+// set, whitespace turned into field separators.
+static void capture_command(ExpandCtx *ctx, char *cmd, bool split) {
+    size_t start = *ctx->j;
+    size_t limit = capture_limit();
+    bool fits = true;
+
+    int fd = capture_inproc(cmd);
+    if (fd >= 0) {
+        fits = read_capture(ctx, fd, limit);
+        close(fd);
+    } else {
+        int pipefd[2];
+        if (pipe2(pipefd, O_CLOEXEC) != 0) return;
+        fcntl(pipefd[0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+        fflush(NULL);
+        out_flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(pipefd[0]);
+            dup2(pipefd[1], STDOUT_FILENO);
+            close(pipefd[1]);
+            exit(process_command_line(cmd));
+        }
+        close(pipefd[1]);
+        if (pid > 0) {
+            fits = read_capture(ctx, pipefd[0], limit);
+            if (!fits) kill(pid, SIGKILL);
+        }
+        close(pipefd[0]);
+        if (pid > 0) waitpid(pid, NULL, 0);
+    }
+
+    if (!fits) {
+        fprintf(stderr, "cvx: command substitution: output exceeds %zu bytes (CVX_CAPTURE_MAX)\n", limit);
+        *ctx->j = start;
+        return;
+    }
+
+    char *buf = *ctx->res;
+    size_t end = *ctx->j;
+    while (end > start && (buf[end-1] == '\n' || buf[end-1] == '\r')) end--;
+    size_t w = start;
+    for (size_t r = start; r < end; r++) {
+        char c = buf[r];
+        if (c == '\0') continue;
+        if (split && isspace((unsigned char)c)) c = '\x11';
+        buf[w++] = c;
+    }
+    *ctx->j = w;
+}
+
 char* expand_variables(const char *input) {
     if (!input) return NULL;
     size_t res_size = 4096;
@@ -501,14 +634,16 @@ char* expand_variables(const char *input) {
                     }
                     i++;
                 }
-                char *expr_raw = strndup(input + start_i, i - start_i);
-                char *expr_expanded = expand_variables(expr_raw);
-                long res_val = evaluate_arithmetic(expr_expanded);
-                char sbuf[32];
-                snprintf(sbuf, sizeof(sbuf), "%ld", res_val);
-                for (int l = 0; sbuf[l]; l++) add_c(&ectx, sbuf[l]);
-                free(expr_raw);
-                free(expr_expanded);
+                size_t expr_len = i - start_i;
+                if (input[i] == ')') expr_len--;
+                char *expr = strndup(input + start_i, expr_len);
+                long res_val;
+                if (expr && evaluate_arithmetic(expr, &res_val)) {
+                    char sbuf[32];
+                    snprintf(sbuf, sizeof(sbuf), "%ld", res_val);
+                    for (int l = 0; sbuf[l]; l++) add_c(&ectx, sbuf[l]);
+                }
+                free(expr);
                 continue;
             }
             if (input[i+1] == '(') {
@@ -525,42 +660,7 @@ char* expand_variables(const char *input) {
                     if (depth > 0) i++;
                 }
                 char *cmd = strndup(input + start_i, i - start_i);
-                int pipefd[2];
-                if (pipe(pipefd) == 0) {
-                    fflush(NULL);
-                    pid_t pid = fork();
-                    if (pid == 0) {
-                        close(pipefd[0]);
-                        dup2(pipefd[1], STDOUT_FILENO);
-                        close(pipefd[1]);
-                        exit(process_command_line(cmd));
-                    } else if (pid > 0) {
-                        close(pipefd[1]);
-                        size_t cap_size = 4096, cap_len = 0;
-                        char *cap = malloc(cap_size), r_buf[4096];
-                        ssize_t n;
-                        while ((n = read(pipefd[0], r_buf, sizeof(r_buf))) > 0) {
-                            if (cap_len + n >= cap_size) {
-                                cap_size *= 2;
-                                cap = realloc(cap, cap_size);
-                            }
-                            if (cap) { memcpy(cap + cap_len, r_buf, n); cap_len += n; }
-                        }
-                        if (cap) {
-                            cap[cap_len] = '\0';
-                            while (cap_len > 0 && (cap[cap_len-1] == '\n' || cap[cap_len-1] == '\r')) cap[--cap_len] = '\0';
-                            bool should_split = !in_dq && !is_assignment;
-                            for (size_t l = 0; cap[l]; l++) {
-                                char c = cap[l];
-                                if (should_split && isspace((unsigned char)c)) c = '\x11';
-                                add_c(&ectx, c);
-                            }
-                            free(cap);
-                        }
-                        close(pipefd[0]);
-                        waitpid(pid, NULL, 0);
-                    }
-                }
+                capture_command(&ectx, cmd, !in_dq && !is_assignment);
                 free(cmd);
                 continue;
             }
@@ -596,11 +696,11 @@ char* expand_variables(const char *input) {
                     word[w] = '\0';
                 }
                 while (input[i] && input[i] != '}') i++;
-                char *ev = NULL;
+                const char *ev = NULL;
                 if (isdigit((unsigned char)var[0])) {
                     int idx = atoi(var);
                     if (param_stack && idx < param_stack->argc) ev = param_stack->argv[idx];
-                } else ev = getenv(var);
+                } else ev = vars_get(var);
                 
                 bool is_set = (ev != NULL), is_null = (ev && !*ev);
                 bool use_def = check_null ? (!is_set || is_null) : !is_set;
@@ -608,7 +708,7 @@ char* expand_variables(const char *input) {
                 if (op == 0) { if (ev) val = strdup(ev); } 
                 else if (op == '-') val = use_def ? expand_variables(word) : strdup(ev?ev:"");
                 else if (op == '=') {
-                    if (use_def) { val = expand_variables(word); setenv(var, val?val:"", 1); }
+                    if (use_def) { val = expand_variables(word); vars_set(var, val?val:""); }
                     else val = strdup(ev?ev:"");
                 } else if (op == '?') {
                     if (use_def) {
@@ -620,9 +720,9 @@ char* expand_variables(const char *input) {
             } else {
                 int start_v = i;
                 while (isalnum((unsigned char)input[i]) || input[i] == '_') i++;
-                char *var = strndup(input + start_v, i - start_v);
-                char *ev = getenv(var); if (ev) val = strdup(ev);
-                free(var); i--;
+                const char *ev = vars_getn(input + start_v, i - start_v);
+                if (ev) val = strdup(ev);
+                i--;
             }
 
             if (val) {
@@ -672,64 +772,32 @@ void quote_removal(char *args[], int argc) {
     }
 }
 
-void expand_glob(char *args[], int *argc, int max_args) {
-    char *new_args[max_args];
-    int new_argc = 0;
-
-    for (int i = 0; i < *argc; i++) {
-        bool has_marker = false;
-        if (args[i]) {
-            for (int k = 0; args[i][k]; k++) {
-                if (args[i][k] == '\x01' || args[i][k] == '\x02' || args[i][k] == '\x03') {
-                    has_marker = true;
-                    break;
-                }
-            }
-        }
-
-        if (has_marker) {
-            char *pattern = strdup(args[i]);
-            for (int k = 0; pattern[k]; k++) {
-                if (pattern[k] == '\x01') pattern[k] = '*';
-                else if (pattern[k] == '\x02') pattern[k] = '?';
-                else if (pattern[k] == '\x03') pattern[k] = '[';
-            }
-
-            glob_t results;
-            int ret = glob(pattern, GLOB_NOCHECK | GLOB_TILDE, NULL, &results);
-            if (ret == 0) {
-                for (size_t j = 0; j < results.gl_pathc && new_argc < max_args - 1; j++) {
-                    new_args[new_argc++] = strdup(results.gl_pathv[j]);
-                }
-                globfree(&results);
-                free(args[i]);
-            } else {
-                for (int k = 0; args[i][k]; k++) {
-                    if (args[i][k] == '\x01') args[i][k] = '*';
-                    else if (args[i][k] == '\x02') args[i][k] = '?';
-                    else if (args[i][k] == '\x03') args[i][k] = '[';
-                }
-                if (new_argc < max_args - 1) {
-                    new_args[new_argc++] = args[i];
-                } else {
-                    free(args[i]);
-                }
+// A word that matches nothing is kept, wildcards and all. *cache is
+// created on first use and left for the caller to free, so that all the
+// words of one command share their directory reads.
+void expand_glob(ArgVec *args, GlobCache **cache) {
+    ArgVec out;
+    argv_init(&out);
+
+    for (int i = 0; i < args->n; i++) {
+        char *arg = args->v[i];
+        if (glob_has_magic(arg)) {
+            if (!*cache) *cache = glob_cache_new();
+            if (*cache && glob_expand(arg, *cache, &out)) {
+                free(arg);
+                continue;
             }
-            free(pattern);
-        } else {
-            if (new_argc < max_args - 1) {
-                new_args[new_argc++] = args[i];
-            } else {
-                free(args[i]);
+            for (int k = 0; arg[k]; k++) {
+                if (arg[k] == '\x01') arg[k] = '*';
+                else if (arg[k] == '\x02') arg[k] = '?';
+                else if (arg[k] == '\x03') arg[k] = '[';
             }
         }
+        argv_push(&out, arg);
     }
-    new_args[new_argc] = NULL;
-    for (int i = 0; i < new_argc; i++) {
-        args[i] = new_args[i];
-    }
-    args[new_argc] = NULL;
-    *argc = new_argc;
+    argv_release(args);
+    for (int i = 0; i < out.n; i++) argv_push(args, out.v[i]);
+    argv_release(&out);
 }
 
 void unescape_args(char *args[], int argc) {
@@ -746,27 +814,26 @@ char* expand_history(const char *line, const char *last_command) {
     if (!line) return NULL;
     if (!last_command) return strdup(line);
 
-    char buffer[8192];
-    int j = 0;
-    int len = strlen(line);
+    size_t len = strlen(line), lclen = strlen(last_command), count = 0;
+    for (size_t i = 0; i + 1 < len; i++)
+        if (line[i] == '!' && line[i+1] == '!') count++;
+    char *buffer = malloc(len + count * lclen + 1);
+    if (!buffer) return NULL;
+    size_t j = 0;
 
-    for (int i = 0; i < len; i++) {
+    for (size_t i = 0; i < len; i++) {
         if (line[i] == '\\' && line[i+1] == '!' && line[i+2] == '!') {
             buffer[j++] = '!';
             buffer[j++] = '!';
             i += 2;
         } else if (line[i] == '!' && line[i+1] == '!') {
-            const char *lc = last_command;
-            while (*lc && j < 8191) {
-                buffer[j++] = *lc++;
-            }
+            memcpy(buffer + j, last_command, lclen);
+            j += lclen;
             i++;
         } else {
-            if (j < 8191) {
-                buffer[j++] = line[i];
-            }
+            buffer[j++] = line[i];
         }
     }
     buffer[j] = '\0';
-    return strdup(buffer);
+    return buffer;
 }
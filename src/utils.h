@@ -6,16 +6,40 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-int split_args(const char *line, char *args[], int max_args);
+#include <stdbool.h>
+
+// A growable, NULL-terminated argument vector. The first ARGV_INLINE
+// slots live in the struct itself, so most commands never allocate for
+// their argv; past that it doubles on the heap. The only bound is memory,
+// and ARG_MAX when the vector is handed to execve(). Since v may point
+// into the struct, an ArgVec must not be copied or moved once in use.
+#define ARGV_INLINE 32
+
+typedef struct {
+    char **v;
+    int n;
+    int cap;
+    char *inline_v[ARGV_INLINE];
+} ArgVec;
+
+void argv_init(ArgVec *a);
+void argv_push(ArgVec *a, char *s);
+void argv_release(ArgVec *a);
+void argv_clear(ArgVec *a);
+char **argv_detach(ArgVec *a, int *count);
+
+int split_args(const char *line, ArgVec *args);
 void free_args(char *args[], int argc);
 char* unescape_string(const char *s);
 void unescape_args(char *args[], int argc);
 char* expand_tilde(const char *path);
 char* expand_variables(const char *input);
-void replace_alias(char *args[], int *argc);
+bool evaluate_arithmetic(const char *expr, long *result);
+void replace_alias(ArgVec *args);
 void handle_redirection(char *args[], int *argc);
 char* expand_history(const char *line, const char *last_command);
-void expand_glob(char *args[], int *argc, int max_args);
+typedef struct GlobCache GlobCache;
+void expand_glob(ArgVec *args, GlobCache **cache);
 void quote_removal(char *args[], int argc);
 
 typedef struct ParamFrame {
@@ -0,0 +1,305 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "vars.h"
+#include "cmdhash.h"
+
+extern char **environ;
+
+typedef struct Var {
+    char *name;
+    char *value;
+    size_t cap;
+    unsigned hash;
+    bool exported;
+    unsigned undo_gen;
+    struct Var *next;
+} Var;
+
+// Values replaced by a prefix assignment, restored after the command,
+// or by an assignment inside an undo scope. value is NULL for a variable
+// that did not exist.
+typedef struct {
+    char *name;
+    char *value;
+    bool exported;
+} TempSave;
+
+static Var **table = NULL;
+static size_t nbuckets = 0;
+static size_t nvars = 0;
+
+static char **env_vec = NULL;
+static bool env_dirty = true;
+
+static TempSave *temps = NULL;
+static int ntemps = 0;
+static int temps_cap = 0;
+
+// While an undo scope is open, the first change to each variable logs
+// its previous state. Every scope gets a fresh generation, so a change
+// is logged again after an inner scope has been rolled back.
+static TempSave *undo_log = NULL;
+static size_t nundo = 0;
+static size_t undo_cap = 0;
+static int undo_depth = 0;
+static unsigned undo_gen = 0;
+static unsigned undo_next_gen = 0;
+
+static unsigned hash_name(const char *name, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool is_valid_name(const char *name, size_t len) {
+    if (len == 0 || isdigit((unsigned char)name[0])) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_') return false;
+    }
+    return true;
+}
+
+static void grow_table(void) {
+    size_t n = nbuckets ? nbuckets * 2 : 64;
+    Var **t = calloc(n, sizeof(Var *));
+    if (!t) return;
+    for (size_t i = 0; i < nbuckets; i++) {
+        Var *v = table[i];
+        while (v) {
+            Var *next = v->next;
+            v->next = t[v->hash & (n - 1)];
+            t[v->hash & (n - 1)] = v;
+            v = next;
+        }
+    }
+    free(table);
+    table = t;
+    nbuckets = n;
+}
+
+static void note_change(Var *v) {
+    if (undo_depth == 0 || v->undo_gen == undo_gen) return;
+    if (nundo == undo_cap) {
+        size_t cap = undo_cap ? undo_cap * 2 : 16;
+        TempSave *log = realloc(undo_log, cap * sizeof(TempSave));
+        if (!log) return;
+        undo_log = log;
+        undo_cap = cap;
+    }
+    TempSave *s = &undo_log[nundo++];
+    s->name = strdup(v->name);
+    s->value = v->value ? strdup(v->value) : NULL;
+    s->exported = v->exported;
+    v->undo_gen = undo_gen;
+}
+
+static Var *lookup(const char *name, size_t len, unsigned h) {
+    if (!table) return NULL;
+    for (Var *v = table[h & (nbuckets - 1)]; v; v = v->next) {
+        if (v->hash == h && strncmp(v->name, name, len) == 0 && v->name[len] == '\0') return v;
+    }
+    return NULL;
+}
+
+static Var *intern(const char *name) {
+    size_t len = strlen(name);
+    unsigned h = hash_name(name, len);
+    Var *v = lookup(name, len, h);
+    if (v) return v;
+
+    if (nvars + 1 > nbuckets * 3 / 4) grow_table();
+    if (!table) return NULL;
+    v = calloc(1, sizeof(Var));
+    if (!v) return NULL;
+    v->name = strdup(name);
+    v->hash = h;
+    v->next = table[h & (nbuckets - 1)];
+    table[h & (nbuckets - 1)] = v;
+    nvars++;
+    note_change(v);
+    return v;
+}
+
+// The value buffer is reused when the new value fits, so a variable
+// assigned in a loop does not churn the allocator.
+static void assign(Var *v, const char *value) {
+    if (v->value && strcmp(v->value, value) == 0) return;
+    note_change(v);
+    size_t len = strlen(value);
+    if (!v->value || v->cap < len + 1) {
+        size_t cap = len + 1 < 16 ? 16 : len + 1;
+        char *buf = realloc(v->value, cap);
+        if (!buf) return;
+        v->value = buf;
+        v->cap = cap;
+    }
+    memcpy(v->value, value, len + 1);
+    if (v->exported) env_dirty = true;
+    if (strcmp(v->name, "PATH") == 0) cmdhash_clear();
+}
+
+void vars_init(char **envp) {
+    for (char **e = envp; e && *e; e++) {
+        const char *eq = strchr(*e, '=');
+        if (!eq || eq == *e) continue;
+        char *name = strndup(*e, eq - *e);
+        if (!name) continue;
+        vars_export(name, eq + 1);
+        free(name);
+    }
+}
+
+const char *vars_getn(const char *name, size_t len) {
+    Var *v = lookup(name, len, hash_name(name, len));
+    return v ? v->value : NULL;
+}
+
+const char *vars_get(const char *name) {
+    return vars_getn(name, strlen(name));
+}
+
+bool vars_is_set(const char *name) {
+    return vars_get(name) != NULL;
+}
+
+void vars_set(const char *name, const char *value) {
+    Var *v = intern(name);
+    if (v) assign(v, value ? value : "");
+}
+
+// Marks name for export, assigning value first when it is not NULL.
+void vars_export(const char *name, const char *value) {
+    Var *v = intern(name);
+    if (!v) return;
+    if (value) assign(v, value);
+    if (!v->value) assign(v, "");
+    if (!v->exported) {
+        note_change(v);
+        v->exported = true;
+        env_dirty = true;
+    }
+}
+
+void vars_unset(const char *name) {
+    size_t len = strlen(name);
+    unsigned h = hash_name(name, len);
+    if (!table) return;
+    Var **link = &table[h & (nbuckets - 1)];
+    for (Var *v = *link; v; link = &v->next, v = v->next) {
+        if (v->hash == h && strcmp(v->name, name) == 0) {
+            note_change(v);
+            *link = v->next;
+            if (v->exported) env_dirty = true;
+            if (strcmp(v->name, "PATH") == 0) cmdhash_clear();
+            free(v->name);
+            free(v->value);
+            free(v);
+            nvars--;
+            return;
+        }
+    }
+}
+
+void vars_push_temp(const char *name, const char *value) {
+    if (ntemps == temps_cap) {
+        int cap = temps_cap ? temps_cap * 2 : 8;
+        TempSave *t = realloc(temps, cap * sizeof(TempSave));
+        if (!t) return;
+        temps = t;
+        temps_cap = cap;
+    }
+    Var *v = intern(name);
+    if (!v) return;
+    TempSave *s = &temps[ntemps++];
+    s->name = strdup(name);
+    s->value = v->value ? strdup(v->value) : NULL;
+    s->exported = v->exported;
+    vars_export(name, value);
+}
+
+static void restore_saved(TempSave *s) {
+    if (!s->value) {
+        vars_unset(s->name);
+    } else {
+        Var *v = intern(s->name);
+        if (v) {
+            assign(v, s->value);
+            if (v->exported != s->exported) {
+                note_change(v);
+                v->exported = s->exported;
+                env_dirty = true;
+            }
+        }
+    }
+    free(s->name);
+    free(s->value);
+}
+
+void vars_pop_temps(int count) {
+    while (count-- > 0 && ntemps > 0) restore_saved(&temps[--ntemps]);
+}
+
+size_t vars_undo_begin(void) {
+    undo_depth++;
+    undo_gen = ++undo_next_gen;
+    return nundo;
+}
+
+// Puts back every variable changed since the matching vars_undo_begin().
+void vars_undo_end(size_t mark) {
+    int depth = undo_depth;
+    undo_depth = 0;
+    while (nundo > mark) restore_saved(&undo_log[--nundo]);
+    undo_depth = depth - 1;
+    undo_gen = ++undo_next_gen;
+}
+
+// Returns the environment for a new process and installs it as environ,
+// so execvp() searches the shell's current PATH.
+char **vars_environ(void) {
+    if (!env_dirty && env_vec) {
+        environ = env_vec;
+        return env_vec;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < nbuckets; i++)
+        for (Var *v = table[i]; v; v = v->next)
+            if (v->exported && v->value) n++;
+
+    char **vec = malloc((n + 1) * sizeof(char *));
+    if (!vec) return environ;
+    size_t k = 0;
+    for (size_t i = 0; i < nbuckets; i++) {
+        for (Var *v = table[i]; v; v = v->next) {
+            if (!v->exported || !v->value) continue;
+            size_t nl = strlen(v->name), vl = strlen(v->value);
+            char *entry = malloc(nl + vl + 2);
+            if (!entry) continue;
+            memcpy(entry, v->name, nl);
+            entry[nl] = '=';
+            memcpy(entry + nl + 1, v->value, vl + 1);
+            vec[k++] = entry;
+        }
+    }
+    vec[k] = NULL;
+
+    if (env_vec) {
+        for (char **e = env_vec; *e; e++) free(*e);
+        free(env_vec);
+    }
+    env_vec = vec;
+    env_dirty = false;
+    environ = env_vec;
+    return env_vec;
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Shell variables live in a hash table owned by the shell. Only exported
+// ones reach child processes, through an envp vector that is rebuilt
+// lazily the next time one of them has changed.
+void vars_init(char **envp);
+const char *vars_get(const char *name);
+const char *vars_getn(const char *name, size_t len);
+void vars_set(const char *name, const char *value);
+void vars_export(const char *name, const char *value);
+bool vars_is_set(const char *name);
+void vars_unset(const char *name);
+void vars_push_temp(const char *name, const char *value);
+void vars_pop_temps(int count);
+size_t vars_undo_begin(void);
+void vars_undo_end(size_t mark);
+char **vars_environ(void);
+bool is_valid_name(const char *name, size_t len);
+
+#endif
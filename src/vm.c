@@ -0,0 +1,357 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "vm.h"
+#include "exec.h"
+#include "functions.h"
+#include "utils.h"
+#include "vars.h"
+#include "out.h"
+
+static int emit(Program *p, OpCode op, bool background, int arg, ASTNode *node) {
+    if (p->len == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 32;
+        p->code = realloc(p->code, p->cap * sizeof(Instr));
+    }
+    Instr *ins = &p->code[p->len];
+    ins->op = op;
+    ins->background = background;
+    ins->arg = arg;
+    ins->node = node;
+    return p->len++;
+}
+
+static void patch(Program *p, int at, int target) {
+    p->code[at].arg = target;
+}
+
+static void compile_node(Program *p, ASTNode *node, bool background) {
+    while (node && node->type == AST_SEQUENCE) {
+        compile_node(p, node->binary.left, false);
+        node = node->binary.right;
+    }
+    if (!node) {
+        emit(p, OP_SET, false, 0, NULL);
+        return;
+    }
+
+    switch (node->type) {
+        case AST_BACKGROUND:
+            compile_node(p, node->unary.body, true);
+            break;
+        case AST_AND:
+        case AST_OR: {
+            compile_node(p, node->binary.left, false);
+            int skip = emit(p, node->type == AST_AND ? OP_JNZ : OP_JZ, false, 0, NULL);
+            compile_node(p, node->binary.right, background);
+            patch(p, skip, p->len);
+            break;
+        }
+        case AST_PIPELINE:
+            emit(p, OP_PIPELINE, background, 0, node);
+            break;
+        case AST_COMMAND:
+            emit(p, OP_CMD, background, 0, node);
+            break;
+        case AST_FUNCDEF:
+            emit(p, OP_FUNCDEF, false, 0, node);
+            break;
+        case AST_IF: {
+            compile_node(p, node->if_stmt.cond, false);
+            int to_else = emit(p, OP_JNZ, false, 0, NULL);
+            compile_node(p, node->if_stmt.then_branch, background);
+            int to_end = emit(p, OP_JMP, false, 0, NULL);
+            patch(p, to_else, p->len);
+            compile_node(p, node->if_stmt.else_branch, background);
+            patch(p, to_end, p->len);
+            break;
+        }
+        case AST_CASE: {
+            int arms = node->case_stmt.narms;
+
+            // OP_CASE jumps into this table by the index of the matching
+            // arm; the extra last slot is taken when nothing matches.
+            emit(p, OP_CASE, false, 0, node);
+            int table = p->len;
+            for (int i = 0; i <= arms; i++) emit(p, OP_JMP, false, 0, NULL);
+
+            int *ends = malloc((arms + 1) * sizeof(int));
+            for (int k = 0; k < arms; k++) {
+                patch(p, table + k, p->len);
+                compile_node(p, node->case_stmt.arms[k].body, background);
+                ends[k] = emit(p, OP_JMP, false, 0, NULL);
+            }
+            patch(p, table + arms, p->len);
+            emit(p, OP_SET, false, 0, NULL);
+            for (int i = 0; i < arms; i++) patch(p, ends[i], p->len);
+            free(ends);
+            break;
+        }
+        case AST_WHILE:
+        case AST_UNTIL: {
+            int loop = emit(p, OP_LOOP, false, 0, NULL);
+            compile_node(p, node->loop.cond, false);
+            int exit_jump = emit(p, node->type == AST_WHILE ? OP_JNZ : OP_JZ, false, 0, NULL);
+            compile_node(p, node->loop.body, background);
+            emit(p, OP_LOOP_SAVE, false, 0, NULL);
+            emit(p, OP_JMP, false, loop + 1, NULL);
+            patch(p, exit_jump, p->len);
+            patch(p, loop, p->len);
+            emit(p, OP_LOOP_END, false, 0, NULL);
+            break;
+        }
+        case AST_FOR: {
+            if (node->for_loop.jobs) {
+                emit(p, OP_FOR_PARALLEL, false, 0, node);
+                break;
+            }
+            int loop = emit(p, OP_FOR, false, 0, node);
+            int next = emit(p, OP_FOR_NEXT, false, 0, node);
+            compile_node(p, node->for_loop.body, background);
+            emit(p, OP_LOOP_SAVE, false, 0, NULL);
+            emit(p, OP_JMP, false, next, NULL);
+            patch(p, next, p->len);
+            patch(p, loop, p->len);
+            emit(p, OP_LOOP_END, false, 0, NULL);
+            break;
+        }
+        case AST_ARITH:
+            emit(p, OP_ARITH, false, 0, node);
+            break;
+        case AST_ARITH_FOR: {
+            // continue re-enters at OP_ARITH_NEXT, which runs the step
+            // expression before testing the condition again.
+            int loop = emit(p, OP_ARITH_FOR, false, 0, node);
+            int next = emit(p, OP_ARITH_NEXT, false, 0, node);
+            compile_node(p, node->arith_for.body, background);
+            emit(p, OP_LOOP_SAVE, false, 0, NULL);
+            emit(p, OP_JMP, false, next, NULL);
+            patch(p, next, p->len);
+            patch(p, loop, p->len);
+            emit(p, OP_LOOP_END, false, 0, NULL);
+            break;
+        }
+        case AST_NEGATION:
+            compile_node(p, node->unary.body, background);
+            emit(p, OP_NEGATE, false, 0, NULL);
+            break;
+        case AST_SUBSHELL: {
+            int fork_at = emit(p, OP_SUBSHELL, background, 0, node);
+            compile_node(p, node->unary.body, false);
+            emit(p, OP_SUBSHELL_END, false, 0, NULL);
+            patch(p, fork_at, p->len);
+            break;
+        }
+        default:
+            emit(p, OP_SET, false, 1, NULL);
+            break;
+    }
+}
+
+Program *vm_compile(ASTNode *node) {
+    Program *p = calloc(1, sizeof(Program));
+    if (!p) return NULL;
+    compile_node(p, node, false);
+    emit(p, OP_HALT, false, 0, NULL);
+    return p;
+}
+
+void vm_free(Program *prog) {
+    if (!prog) return;
+    free(prog->code);
+    free(prog);
+}
+
+typedef struct {
+    int brk;
+    int cont;
+    int result;
+    int next;
+    ForIter iter;
+} LoopFrame;
+
+static void drop_frame(LoopFrame *f) {
+    for_iter_free(&f->iter);
+}
+
+int vm_run(Program *prog) {
+    if (!prog) return 0;
+
+    LoopFrame *frames = NULL;
+    int sp = 0, frames_cap = 0;
+    int base = 0;
+    bool in_subshell = false;
+    int status = 0;
+    int pc = 0;
+
+    for (;;) {
+        Instr *ins = &prog->code[pc];
+        bool check = false;
+
+        switch (ins->op) {
+            case OP_HALT:
+                goto done;
+            case OP_CMD:
+                status = exec_node(ins->node, ins->background);
+                check = true;
+                pc++;
+                break;
+            case OP_PIPELINE:
+                status = execute_pipeline_node(ins->node, ins->background);
+                check = true;
+                pc++;
+                break;
+            case OP_FUNCDEF:
+                add_function(ins->node->funcdef.name, ins->node->funcdef.body);
+                status = 0;
+                pc++;
+                break;
+            case OP_SUBSHELL: {
+                out_flush();
+                pid_t pid = fork();
+                if (pid < 0) {
+                    perror("fork");
+                    status = 1;
+                    pc = ins->arg;
+                    break;
+                }
+                if (pid == 0) {
+                    signal(SIGINT, SIG_DFL);
+                    signal(SIGTSTP, SIG_DFL);
+                    base = sp;
+                    in_subshell = true;
+                    pc++;
+                    break;
+                }
+                if (ins->background) {
+                    status = 0;
+                } else {
+                    int wstatus = 0;
+                    waitpid(pid, &wstatus, 0);
+                    last_exit_status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : (WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : 0);
+                    status = last_exit_status;
+                }
+                check = true;
+                pc = ins->arg;
+                break;
+            }
+            case OP_SUBSHELL_END:
+                exit(status);
+            case OP_SET:
+                status = ins->arg;
+                pc++;
+                break;
+            case OP_NEGATE:
+                last_exit_status = (status == 0 ? 1 : 0);
+                status = last_exit_status;
+                pc++;
+                break;
+            case OP_JMP:
+                pc = ins->arg;
+                break;
+            case OP_JZ:
+                pc = (status == 0) ? ins->arg : pc + 1;
+                break;
+            case OP_JNZ:
+                pc = (status != 0) ? ins->arg : pc + 1;
+                break;
+            case OP_CASE: {
+                int arm = case_select(ins->node);
+                pc = pc + 1 + (arm >= 0 ? arm : ins->node->case_stmt.narms);
+                break;
+            }
+            case OP_ARITH:
+                status = arith_status(ins->node->arith.expr);
+                pc++;
+                break;
+            case OP_LOOP:
+            case OP_FOR:
+            case OP_ARITH_FOR: {
+                if (sp == frames_cap) {
+                    frames_cap = frames_cap ? frames_cap * 2 : 8;
+                    frames = realloc(frames, frames_cap * sizeof(LoopFrame));
+                }
+                LoopFrame *f = &frames[sp++];
+                f->brk = ins->arg;
+                f->cont = pc + 1;
+                f->result = 0;
+                f->next = 0;
+                if (ins->op == OP_FOR) {
+                    for_iter_init(&f->iter, ins->node);
+                } else {
+                    memset(&f->iter, 0, sizeof(f->iter));
+                }
+                if (ins->op == OP_ARITH_FOR && ins->node->arith_for.init) {
+                    arith_status(ins->node->arith_for.init);
+                }
+                pc++;
+                break;
+            }
+            case OP_ARITH_NEXT: {
+                // next counts the iterations started, so the step is
+                // skipped before the first one.
+                LoopFrame *f = &frames[sp - 1];
+                ASTNode *n = ins->node;
+                if (f->next++ > 0 && n->arith_for.step) arith_status(n->arith_for.step);
+                if (sigint_received || (n->arith_for.cond && arith_status(n->arith_for.cond) != 0)) {
+                    pc = ins->arg;
+                    break;
+                }
+                pc++;
+                break;
+            }
+            case OP_FOR_NEXT: {
+                LoopFrame *f = &frames[sp - 1];
+                const char *value = sigint_received ? NULL : for_iter_next(&f->iter);
+                if (!value) {
+                    pc = ins->arg;
+                    break;
+                }
+                vars_set(ins->node->for_loop.var, value);
+                pc++;
+                break;
+            }
+            case OP_FOR_PARALLEL:
+                status = for_parallel(ins->node);
+                check = true;
+                pc++;
+                break;
+            case OP_LOOP_SAVE:
+                frames[sp - 1].result = status;
+                pc++;
+                break;
+            case OP_LOOP_END:
+                status = frames[sp - 1].result;
+                drop_frame(&frames[--sp]);
+                pc++;
+                break;
+            default:
+                status = 1;
+                goto done;
+        }
+
+        if (check && (loop_control != 0 || sigint_received)) {
+            if (sigint_received || sp == base) goto done;
+            LoopFrame *f = &frames[sp - 1];
+            f->result = status;
+            pc = (loop_control == 1) ? f->brk : f->cont;
+            loop_control = 0;
+        }
+    }
+
+done:
+    if (in_subshell) exit(status);
+    while (sp > 0) drop_frame(&frames[--sp]);
+    free(frames);
+    return status;
+}
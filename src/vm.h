@@ -0,0 +1,55 @@
+// Copyright (c) 2025-2026 JHXStudioriginal
+// This file is part of the Elasna Open Source License v3.
+// All original author information and file headers must be preserved.
+// For full license text, see: [https://github.com/JHXStudioriginal/Elasna-License/blob/main/LICENSE]
+
+#ifndef VM_H
+#define VM_H
+
+#include <stdbool.h>
+#include "ast.h"
+
+typedef enum {
+    OP_HALT,
+    OP_CMD,
+    OP_PIPELINE,
+    OP_FUNCDEF,
+    OP_SUBSHELL,
+    OP_SUBSHELL_END,
+    OP_SET,
+    OP_NEGATE,
+    OP_JMP,
+    OP_JZ,
+    OP_JNZ,
+    OP_CASE,
+    OP_LOOP,
+    OP_FOR,
+    OP_FOR_NEXT,
+    OP_FOR_PARALLEL,
+    OP_LOOP_SAVE,
+    OP_LOOP_END,
+    OP_ARITH,
+    OP_ARITH_FOR,
+    OP_ARITH_NEXT
+} OpCode;
+
+// One instruction. Commands still point back at their AST node, which
+// must outlive the program; `arg` is a jump target or a constant.
+typedef struct {
+    unsigned char op;
+    bool background;
+    int arg;
+    ASTNode *node;
+} Instr;
+
+typedef struct {
+    Instr *code;
+    int len;
+    int cap;
+} Program;
+
+Program *vm_compile(ASTNode *node);
+void vm_free(Program *prog);
+int vm_run(Program *prog);
+
+#endif
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Runs every tests/*.cvx script with the shell given as $1 (./cvx by
+# default) and compares its output with the matching .out file. Each
+# script runs on the VM, under shopt -s treewalk, and from the script
+# cache (the first --cache run writes it, the second one loads it).
+cvx=${1:-./cvx}
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+run() {
+    case $1 in
+    vm)
+        "$cvx" "$2" ;;
+    treewalk)
+        { echo 'shopt -s treewalk'; cat "$2"; } > "$tmp/treewalk.cvx"
+        "$cvx" "$tmp/treewalk.cvx" ;;
+    cache)
+        XDG_CACHE_HOME=$tmp "$cvx" --cache "$2" > /dev/null 2>&1
+        XDG_CACHE_HOME=$tmp "$cvx" --cache "$2" ;;
+    esac
+}
+
+fail=0
+for t in "$dir"/*.cvx; do
+    for mode in vm treewalk cache; do
+        if ! run $mode "$t" 2>&1 | diff -u "${t%.cvx}.out" - > /dev/null; then
+            echo "FAIL: $t ($mode)"
+            fail=1
+        fi
+    done
+done
+[ $fail -eq 0 ] && echo "all tests passed"
+exit $fail